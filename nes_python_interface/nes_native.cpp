@@ -0,0 +1,433 @@
+/* nes_native.cpp
+   CPython extension with the calls made every step: act, actPlayers, game_over,
+   reset_game, the screen, observation and sprite copies, the batch and send/recv
+   APIs and the fork server.
+   Objects are the handles returned by the ctypes constructors in
+   nes_python_interface.py, arrays are taken through the buffer protocol,
+   and the GIL is released while the emulator runs.
+*/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "nes_interface.hpp"
+#include "nes_vector_env.hpp"
+#include "nes_fork_server.hpp"
+
+using nes::NESInterface;
+using nes::NESVectorEnv;
+using nes::NESForkServer;
+
+// Turns a handle into a pointer, failing on NULL.
+static void *handleToPointer(PyObject *handle) {
+
+	void *p = PyLong_AsVoidPtr(handle);
+	if (!p && !PyErr_Occurred()) {
+		PyErr_SetString(PyExc_ValueError, "NULL handle");
+	}
+	return p;
+}
+
+// Gets a contiguous buffer of at least min_bytes bytes with the given item
+// size (0 for any).
+static bool getBuffer(PyObject *obj, Py_buffer *view, bool writable, Py_ssize_t min_bytes,
+                      Py_ssize_t itemsize, const char *name) {
+
+	if (PyObject_GetBuffer(obj, view, writable ? PyBUF_CONTIG : PyBUF_CONTIG_RO) < 0) {
+		return false;
+	}
+	if (itemsize && view->itemsize != itemsize) {
+		PyErr_Format(PyExc_TypeError, "%s must have %zd byte items", name, itemsize);
+		PyBuffer_Release(view);
+		return false;
+	}
+	if (view->len < min_bytes) {
+		PyErr_Format(PyExc_ValueError, "%s must hold at least %zd bytes", name, min_bytes);
+		PyBuffer_Release(view);
+		return false;
+	}
+	return true;
+}
+
+static PyObject *nes_act(PyObject *self, PyObject *args) {
+
+	PyObject *handle;
+	int action, repeat = 1, skip_sound = 0;
+	if (!PyArg_ParseTuple(args, "Oi|ip", &handle, &action, &repeat, &skip_sound)) {
+		return NULL;
+	}
+	NESInterface *nes = (NESInterface *) handleToPointer(handle);
+	if (!nes) {
+		return NULL;
+	}
+
+	int reward;
+	Py_BEGIN_ALLOW_THREADS
+	reward = repeat == 1 ? nes->act(action) : nes->act(action, repeat, skip_sound != 0);
+	Py_END_ALLOW_THREADS
+	return PyLong_FromLong(reward);
+}
+
+static PyObject *nes_act_players(PyObject *self, PyObject *args) {
+
+	PyObject *handle;
+	int action1, action2, repeat = 1, skip_sound = 0;
+	if (!PyArg_ParseTuple(args, "Oii|ip", &handle, &action1, &action2, &repeat, &skip_sound)) {
+		return NULL;
+	}
+	NESInterface *nes = (NESInterface *) handleToPointer(handle);
+	if (!nes) {
+		return NULL;
+	}
+
+	int reward;
+	Py_BEGIN_ALLOW_THREADS
+	reward = nes->actPlayers(action1, action2, repeat, skip_sound != 0);
+	Py_END_ALLOW_THREADS
+	return PyLong_FromLong(reward);
+}
+
+static PyObject *nes_game_over(PyObject *self, PyObject *handle) {
+
+	NESInterface *nes = (NESInterface *) handleToPointer(handle);
+	if (!nes) {
+		return NULL;
+	}
+	return PyBool_FromLong(nes->gameOver());
+}
+
+static PyObject *nes_reset_game(PyObject *self, PyObject *handle) {
+
+	NESInterface *nes = (NESInterface *) handleToPointer(handle);
+	if (!nes) {
+		return NULL;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	nes->resetGame();
+	Py_END_ALLOW_THREADS
+	Py_RETURN_NONE;
+}
+
+static PyObject *nes_get_screen(PyObject *self, PyObject *args) {
+
+	PyObject *handle, *out;
+	if (!PyArg_ParseTuple(args, "OO", &handle, &out)) {
+		return NULL;
+	}
+	NESInterface *nes = (NESInterface *) handleToPointer(handle);
+	if (!nes) {
+		return NULL;
+	}
+
+	Py_buffer view;
+	if (!getBuffer(out, &view, true, nes->getScreenWidth() * nes->getScreenHeight(), 1, "screen_data")) {
+		return NULL;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	nes->getScreen((unsigned char *) view.buf, view.len);
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&view);
+	Py_RETURN_NONE;
+}
+
+static PyObject *nes_get_screen_rgb(PyObject *self, PyObject *args) {
+
+	PyObject *handle, *out;
+	int format = RGB_FORMAT_RGB24;
+	if (!PyArg_ParseTuple(args, "OO|i", &handle, &out, &format)) {
+		return NULL;
+	}
+	NESInterface *nes = (NESInterface *) handleToPointer(handle);
+	if (!nes) {
+		return NULL;
+	}
+
+	int channels = format == RGB_FORMAT_RGBA32 ? 4 : 3;
+	Py_buffer view;
+	if (!getBuffer(out, &view, true, nes->getScreenWidth() * nes->getScreenHeight() * channels, 1, "screen_data")) {
+		return NULL;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	nes->getScreenRGB((unsigned char *) view.buf, view.len, format);
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&view);
+	Py_RETURN_NONE;
+}
+
+static PyObject *nes_get_observation(PyObject *self, PyObject *args) {
+
+	PyObject *handle, *out;
+	if (!PyArg_ParseTuple(args, "OO", &handle, &out)) {
+		return NULL;
+	}
+	NESInterface *nes = (NESInterface *) handleToPointer(handle);
+	if (!nes) {
+		return NULL;
+	}
+
+	Py_buffer view;
+	if (!getBuffer(out, &view, true, nes->getObservationSize(), 1, "obs")) {
+		return NULL;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	nes->getObservation((unsigned char *) view.buf, view.len);
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&view);
+	Py_RETURN_NONE;
+}
+
+static PyObject *nes_get_sprite_observation(PyObject *self, PyObject *args) {
+
+	PyObject *handle, *oam_obj, *lines_obj, *counts_obj, *scroll_obj;
+	if (!PyArg_ParseTuple(args, "OOOOO", &handle, &oam_obj, &lines_obj, &counts_obj, &scroll_obj)) {
+		return NULL;
+	}
+	NESInterface *nes = (NESInterface *) handleToPointer(handle);
+	if (!nes) {
+		return NULL;
+	}
+
+	Py_buffer oam, lines, counts, scroll;
+	if (!getBuffer(oam_obj, &oam, true, NES_NUM_SPRITES * 4 * sizeof(int), sizeof(int), "oam")) {
+		return NULL;
+	}
+	if (!getBuffer(lines_obj, &lines, true, NES_SCREEN_LINES * NES_SPRITES_PER_LINE, 1, "line_sprites")) {
+		PyBuffer_Release(&oam);
+		return NULL;
+	}
+	if (!getBuffer(counts_obj, &counts, true, NES_SCREEN_LINES, 1, "line_counts")) {
+		PyBuffer_Release(&lines);
+		PyBuffer_Release(&oam);
+		return NULL;
+	}
+	if (!getBuffer(scroll_obj, &scroll, true, 2 * sizeof(int), sizeof(int), "scroll")) {
+		PyBuffer_Release(&counts);
+		PyBuffer_Release(&lines);
+		PyBuffer_Release(&oam);
+		return NULL;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	nes->getSpriteObservation((int *) oam.buf, (unsigned char *) lines.buf,
+			(unsigned char *) counts.buf, (int *) scroll.buf);
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&scroll);
+	PyBuffer_Release(&counts);
+	PyBuffer_Release(&lines);
+	PyBuffer_Release(&oam);
+	Py_RETURN_NONE;
+}
+
+static PyObject *nes_reset_all(PyObject *self, PyObject *handle) {
+
+	NESVectorEnv *vec = (NESVectorEnv *) handleToPointer(handle);
+	if (!vec) {
+		return NULL;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	vec->resetAll();
+	Py_END_ALLOW_THREADS
+	Py_RETURN_NONE;
+}
+
+static PyObject *nes_act_batch(PyObject *self, PyObject *args) {
+
+	PyObject *handle, *actions_obj, *rewards_obj, *dones_obj, *screens_obj;
+	if (!PyArg_ParseTuple(args, "OOOOO", &handle, &actions_obj, &rewards_obj, &dones_obj, &screens_obj)) {
+		return NULL;
+	}
+	NESVectorEnv *vec = (NESVectorEnv *) handleToPointer(handle);
+	if (!vec) {
+		return NULL;
+	}
+
+	Py_ssize_t n = vec->getNumEnvs();
+	Py_buffer actions, rewards, dones, screens;
+	if (!getBuffer(actions_obj, &actions, false, n * sizeof(int), sizeof(int), "actions")) {
+		return NULL;
+	}
+	if (!getBuffer(rewards_obj, &rewards, true, n * sizeof(int), sizeof(int), "rewards")) {
+		PyBuffer_Release(&actions);
+		return NULL;
+	}
+	if (!getBuffer(dones_obj, &dones, true, n * sizeof(bool), sizeof(bool), "dones")) {
+		PyBuffer_Release(&actions);
+		PyBuffer_Release(&rewards);
+		return NULL;
+	}
+	bool with_screens = screens_obj != Py_None;
+	if (with_screens && !getBuffer(screens_obj, &screens, true, n * vec->getScreenSize(), 1, "screens")) {
+		PyBuffer_Release(&actions);
+		PyBuffer_Release(&rewards);
+		PyBuffer_Release(&dones);
+		return NULL;
+	}
+
+	bool ok;
+	Py_BEGIN_ALLOW_THREADS
+	ok = vec->act((const int *) actions.buf, (int *) rewards.buf, (bool *) dones.buf,
+	              with_screens ? (unsigned char *) screens.buf : NULL);
+	Py_END_ALLOW_THREADS
+
+	PyBuffer_Release(&actions);
+	PyBuffer_Release(&rewards);
+	PyBuffer_Release(&dones);
+	if (with_screens) {
+		PyBuffer_Release(&screens);
+	}
+	return PyBool_FromLong(ok);
+}
+
+static PyObject *nes_send_batch(PyObject *self, PyObject *args) {
+
+	PyObject *handle, *env_ids_obj, *actions_obj;
+	if (!PyArg_ParseTuple(args, "OOO", &handle, &env_ids_obj, &actions_obj)) {
+		return NULL;
+	}
+	NESVectorEnv *vec = (NESVectorEnv *) handleToPointer(handle);
+	if (!vec) {
+		return NULL;
+	}
+
+	Py_buffer env_ids, actions;
+	if (!getBuffer(env_ids_obj, &env_ids, false, 0, sizeof(int), "env_ids")) {
+		return NULL;
+	}
+	if (!getBuffer(actions_obj, &actions, false, env_ids.len, sizeof(int), "actions")) {
+		PyBuffer_Release(&env_ids);
+		return NULL;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	vec->send((const int *) env_ids.buf, (const int *) actions.buf, env_ids.len / sizeof(int));
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&env_ids);
+	PyBuffer_Release(&actions);
+	Py_RETURN_NONE;
+}
+
+static PyObject *nes_recv_batch(PyObject *self, PyObject *args) {
+
+	PyObject *handle, *env_ids_obj, *rewards_obj, *dones_obj, *screens_obj;
+	int min_count = 1;
+	if (!PyArg_ParseTuple(args, "OOOOO|i", &handle, &env_ids_obj, &rewards_obj, &dones_obj, &screens_obj, &min_count)) {
+		return NULL;
+	}
+	NESVectorEnv *vec = (NESVectorEnv *) handleToPointer(handle);
+	if (!vec) {
+		return NULL;
+	}
+
+	// Every buffer holds a result for each environment.
+	Py_ssize_t n = vec->getNumEnvs();
+	Py_buffer env_ids, rewards, dones, screens;
+	if (!getBuffer(env_ids_obj, &env_ids, true, n * sizeof(int), sizeof(int), "env_ids")) {
+		return NULL;
+	}
+	if (!getBuffer(rewards_obj, &rewards, true, n * sizeof(int), sizeof(int), "rewards")) {
+		PyBuffer_Release(&env_ids);
+		return NULL;
+	}
+	if (!getBuffer(dones_obj, &dones, true, n * sizeof(bool), sizeof(bool), "dones")) {
+		PyBuffer_Release(&env_ids);
+		PyBuffer_Release(&rewards);
+		return NULL;
+	}
+	bool with_screens = screens_obj != Py_None;
+	if (with_screens && !getBuffer(screens_obj, &screens, true, n * vec->getScreenSize(), 1, "screens")) {
+		PyBuffer_Release(&env_ids);
+		PyBuffer_Release(&rewards);
+		PyBuffer_Release(&dones);
+		return NULL;
+	}
+
+	int count;
+	Py_BEGIN_ALLOW_THREADS
+	count = vec->recv((int *) env_ids.buf, (int *) rewards.buf, (bool *) dones.buf,
+	                  with_screens ? (unsigned char *) screens.buf : NULL, n, min_count);
+	Py_END_ALLOW_THREADS
+
+	PyBuffer_Release(&env_ids);
+	PyBuffer_Release(&rewards);
+	PyBuffer_Release(&dones);
+	if (with_screens) {
+		PyBuffer_Release(&screens);
+	}
+	return PyLong_FromLong(count);
+}
+
+static PyObject *nes_fork_reset_all(PyObject *self, PyObject *handle) {
+
+	NESForkServer *server = (NESForkServer *) handleToPointer(handle);
+	if (!server) {
+		return NULL;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	server->resetAll();
+	Py_END_ALLOW_THREADS
+	Py_RETURN_NONE;
+}
+
+static PyObject *nes_fork_act(PyObject *self, PyObject *args) {
+
+	PyObject *handle, *actions_obj;
+	if (!PyArg_ParseTuple(args, "OO", &handle, &actions_obj)) {
+		return NULL;
+	}
+	NESForkServer *server = (NESForkServer *) handleToPointer(handle);
+	if (!server) {
+		return NULL;
+	}
+
+	Py_buffer actions;
+	if (!getBuffer(actions_obj, &actions, false, server->getNumEnvs() * sizeof(int), sizeof(int), "actions")) {
+		return NULL;
+	}
+	bool ok;
+	Py_BEGIN_ALLOW_THREADS
+	ok = server->act((const int *) actions.buf);
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&actions);
+	return PyBool_FromLong(ok);
+}
+
+static PyMethodDef nes_native_methods[] = {
+	{ "act", nes_act, METH_VARARGS,
+	  "act(handle, action, repeat=1, skip_sound=False) -> reward" },
+	{ "actPlayers", nes_act_players, METH_VARARGS,
+	  "actPlayers(handle, action1, action2, repeat=1, skip_sound=False) -> reward" },
+	{ "game_over", nes_game_over, METH_O,
+	  "game_over(handle) -> bool" },
+	{ "reset_game", nes_reset_game, METH_O,
+	  "reset_game(handle)" },
+	{ "getScreen", nes_get_screen, METH_VARARGS,
+	  "getScreen(handle, screen_data) fills a writable uint8 buffer with the raw screen" },
+	{ "getScreenRGB", nes_get_screen_rgb, METH_VARARGS,
+	  "getScreenRGB(handle, screen_data, format=RGB_FORMAT_RGB24)" },
+	{ "getObservation", nes_get_observation, METH_VARARGS,
+	  "getObservation(handle, obs)" },
+	{ "getSpriteObservation", nes_get_sprite_observation, METH_VARARGS,
+	  "getSpriteObservation(handle, oam, line_sprites, line_counts, scroll)" },
+	{ "resetAll", nes_reset_all, METH_O,
+	  "resetAll(vector_handle)" },
+	{ "actBatch", nes_act_batch, METH_VARARGS,
+	  "actBatch(vector_handle, actions, rewards, dones, screens_or_None) -> False if a worker died" },
+	{ "sendBatch", nes_send_batch, METH_VARARGS,
+	  "sendBatch(vector_handle, env_ids, actions)" },
+	{ "recvBatch", nes_recv_batch, METH_VARARGS,
+	  "recvBatch(vector_handle, env_ids, rewards, dones, screens_or_None, min_count=1) -> count" },
+	{ "forkResetAll", nes_fork_reset_all, METH_O,
+	  "forkResetAll(server_handle)" },
+	{ "forkAct", nes_fork_act, METH_VARARGS,
+	  "forkAct(server_handle, actions) -> False if a worker died" },
+	{ NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef nes_native_module = {
+	PyModuleDef_HEAD_INIT,
+	"_nes_native",
+	"Fast paths for the per-step calls of nes_python_interface.",
+	-1,
+	nes_native_methods
+};
+
+PyMODINIT_FUNC PyInit__nes_native(void) {
+	return PyModule_Create(&nes_native_module);
+}
@@ -2,7 +2,7 @@
 # Author: Ben Goodrich, Ehren J. Brav
 # This partially implements a python version of the arcade learning
 # environment interface.
-__all__ = ['NESInterface']
+__all__ = ['NESInterface', 'NESVectorEnv', 'NESForkServer', 'DeltaState', 'RGB_FORMAT_RGB24', 'RGB_FORMAT_BGR24', 'RGB_FORMAT_RGBA32']
 
 from ctypes import *
 import numpy as np
@@ -11,13 +11,87 @@ import os
 
 nes_lib = cdll.LoadLibrary(os.path.join(os.path.dirname(__file__), 'libfceux.so'))
 
+# The compiled extension built by setup.py takes over the per-step calls
+# when it is available; everything else goes through ctypes.
+try:
+    from . import _nes_native
+except ImportError:
+    _nes_native = None
+
+# Search the game descriptors shipped with the package after any the user
+# points NES_GAMES_PATH at.
+os.environ['NES_GAMES_PATH'] = os.pathsep.join(filter(None, [
+    os.environ.get('NES_GAMES_PATH'), os.path.join(os.path.dirname(__file__), 'games')]))
+
+# Pixel layouts for getScreenRGB, as in nes_interface.hpp.
+RGB_FORMAT_RGB24 = 0
+RGB_FORMAT_BGR24 = 1
+RGB_FORMAT_RGBA32 = 2
+
 class NESInterface(object):
+    """One emulated NES. Several may be created in one process, but they
+    share the emulator core and run one at a time; all must use the same
+    ROM, otherwise the constructor raises RuntimeError.
+    """
     def __init__(self, rom):
         nes_lib.NESInterface.argtypes = [c_char_p]
         nes_lib.NESInterface.restype = c_void_p
         byte_string_rom = rom.encode('utf-8')
         self.obj = nes_lib.NESInterface(byte_string_rom)
+        nes_lib.isValid.argtypes = [c_void_p]
+        nes_lib.isValid.restype = c_bool
+        if not nes_lib.isValid(self.obj):
+            raise RuntimeError('NESInterface cannot load %s next to the ROM already running in this process' % rom)
         self.width, self.height = self.getScreenDims()
+        self.obs_shape = (84, 84, 1)
+
+    def loadGameDescriptor(self, path):
+        """Replaces the score, reward, lives and game over rules with the
+        game descriptor file at path. Returns False if it could not be read.
+        """
+        nes_lib.loadGameDescriptor.argtypes = [c_void_p, c_char_p]
+        nes_lib.loadGameDescriptor.restype = c_bool
+        return nes_lib.loadGameDescriptor(self.obj, path.encode('utf-8'))
+
+    def generateStartPool(self, num_states, max_noops=30, seed=1):
+        """Fills the start pool with num_states states reached by 0 to
+        max_noops random no-op frames after a reset. While the pool is not
+        empty, reset_game starts from one of them at random. The pool is
+        shared by every environment in the process.
+        """
+        nes_lib.generateStartPool.argtypes = [c_void_p, c_int, c_int, c_uint]
+        nes_lib.generateStartPool.restype = None
+        nes_lib.generateStartPool(self.obj, int(num_states), int(max_noops), int(seed))
+
+    def addStartState(self):
+        """Adds the current state to the start pool."""
+        nes_lib.addStartState.argtypes = [c_void_p]
+        nes_lib.addStartState.restype = None
+        nes_lib.addStartState(self.obj)
+
+    def clearStartPool(self):
+        nes_lib.clearStartPool.argtypes = [c_void_p]
+        nes_lib.clearStartPool.restype = None
+        nes_lib.clearStartPool(self.obj)
+
+    def getStartPoolSize(self):
+        nes_lib.getStartPoolSize.argtypes = [c_void_p]
+        nes_lib.getStartPoolSize.restype = c_int
+        return nes_lib.getStartPoolSize(self.obj)
+
+    def saveStartPool(self, path):
+        """Writes the start pool to path, so other processes can load it."""
+        nes_lib.saveStartPool.argtypes = [c_void_p, c_char_p]
+        nes_lib.saveStartPool.restype = c_bool
+        return nes_lib.saveStartPool(self.obj, path.encode('utf-8'))
+
+    def loadStartPool(self, path):
+        """Replaces the start pool with the one saved at path. Returns False
+        if it could not be read or was made for another ROM or descriptor.
+        """
+        nes_lib.loadStartPool.argtypes = [c_void_p, c_char_p]
+        nes_lib.loadStartPool.restype = c_bool
+        return nes_lib.loadStartPool(self.obj, path.encode('utf-8'))
 
     # def getString(self, key):
     #     return nes_lib.getString(self.obj, key)
@@ -40,21 +114,99 @@ class NESInterface(object):
     # def loadROM(self, rom_file):
     #     nes_lib.loadROM(self.obj, rom_file)
 
-    def act(self, action):
-        nes_lib.act.argtypes = [c_void_p, c_int]
-        nes_lib.act.restype = c_int
-        return nes_lib.act(self.obj, int(action))
+    def act(self, action, repeat=1, skip_sound=False):
+        """Applies action for repeat frames and returns the summed reward.
+        Only the last frame is rendered, and if skip_sound is True the
+        intermediate frames skip sound emulation as well.
+        """
+        if _nes_native is not None:
+            return _nes_native.act(self.obj, action, repeat, skip_sound)
+        if repeat == 1:
+            nes_lib.act.argtypes = [c_void_p, c_int]
+            nes_lib.act.restype = c_int
+            return nes_lib.act(self.obj, int(action))
+        nes_lib.actRepeat.argtypes = [c_void_p, c_int, c_int, c_bool]
+        nes_lib.actRepeat.restype = c_int
+        return nes_lib.actRepeat(self.obj, int(action), int(repeat), bool(skip_sound))
+
+    def actPlayers(self, action1, action2, repeat=1, skip_sound=False):
+        """Like act, but player 1 plays action1 and player 2 action2. act
+        leaves the second gamepad idle.
+        """
+        if _nes_native is not None:
+            return _nes_native.actPlayers(self.obj, action1, action2, repeat, skip_sound)
+        nes_lib.actPlayers.argtypes = [c_void_p, c_int, c_int, c_int, c_bool]
+        nes_lib.actPlayers.restype = c_int
+        return nes_lib.actPlayers(self.obj, int(action1), int(action2), int(repeat),
+                                  bool(skip_sound))
 
     def game_over(self):
+        if _nes_native is not None:
+            return _nes_native.game_over(self.obj)
         nes_lib.gameOver.argtypes = [c_void_p]
         nes_lib.gameOver.restype = c_bool
         return nes_lib.gameOver(self.obj)
 
-    def reset_game(self):
+    def reset_game(self, seed=None):
+        """Resets the game. Given an episode seed from getEpisodeSeed, the
+        episode is replayed exactly when the same actions are taken.
+        """
+        if seed is not None:
+            nes_lib.resetGameWithSeed.argtypes = [c_void_p, c_uint]
+            nes_lib.resetGameWithSeed.restype = None
+            return nes_lib.resetGameWithSeed(self.obj, seed)
+        if _nes_native is not None:
+            return _nes_native.reset_game(self.obj)
         nes_lib.resetGame.argtypes = [c_void_p]
         nes_lib.resetGame.restype = None
         nes_lib.resetGame(self.obj)
 
+    def setSeed(self, seed):
+        """Seeds the generator the episode seeds of reset_game are drawn
+        from. The episode seed drives all randomness of an episode: power-on
+        RAM (with setRandomizeRAM), no-op starts, start pool choice and
+        sticky actions.
+        """
+        nes_lib.setSeed.argtypes = [c_void_p, c_uint]
+        nes_lib.setSeed.restype = None
+        nes_lib.setSeed(self.obj, seed)
+
+    def getEpisodeSeed(self):
+        nes_lib.getEpisodeSeed.argtypes = [c_void_p]
+        nes_lib.getEpisodeSeed.restype = c_uint
+        return nes_lib.getEpisodeSeed(self.obj)
+
+    def setRandomizeRAM(self, randomize):
+        """If True, every reset power-cycles the console with RAM filled from
+        the episode seed. Resets get much slower as nothing can be cached.
+        """
+        nes_lib.setRandomizeRAM.argtypes = [c_void_p, c_bool]
+        nes_lib.setRandomizeRAM.restype = None
+        nes_lib.setRandomizeRAM(self.obj, randomize)
+
+    def setNoopStarts(self, max_noops):
+        """Plays 0 to max_noops random NOOP frames after every reset."""
+        nes_lib.setNoopStarts.argtypes = [c_void_p, c_int]
+        nes_lib.setNoopStarts.restype = None
+        nes_lib.setNoopStarts(self.obj, max_noops)
+
+    def setRepeatActionProbability(self, probability):
+        """Sets the probability that each frame keeps the previous input
+        instead of the requested action (sticky actions).
+        """
+        nes_lib.setRepeatActionProbability.argtypes = [c_void_p, c_float]
+        nes_lib.setRepeatActionProbability.restype = None
+        nes_lib.setRepeatActionProbability(self.obj, probability)
+
+    def setLazyRendering(self, lazy):
+        """If set, frames are only drawn when the screen is read, which
+        makes stepping without looking at every frame cheaper. Emulation is
+        unchanged. Views from getScreenView are not updated in this mode.
+        """
+        nes_lib.setLazyRendering.argtypes = [c_void_p, c_bool]
+        nes_lib.setLazyRendering.restype = None
+        nes_lib.setLazyRendering(self.obj, lazy)
+
     def getLegalActionSet(self):
         nes_lib.getNumLegalActions.argtypes = [c_void_p]
         nes_lib.getNumLegalActions.restype = c_int
@@ -66,9 +218,17 @@ class NESInterface(object):
         return act
 
     def getMinimalActionSet(self):
-        # For NES we assume this is the same
-        # as the legal actions.
-        return self.getLegalActionSet()
+        """Returns the actions the game needs, as listed by its game
+        descriptor, or the legal actions if it lists none.
+        """
+        nes_lib.getNumMinimalActions.argtypes = [c_void_p]
+        nes_lib.getNumMinimalActions.restype = c_int
+        act_size = nes_lib.getNumMinimalActions(self.obj)
+        act = np.zeros(shape=(act_size,), dtype=c_int)
+        nes_lib.getMinimalActionSet.argtypes = [c_void_p, c_void_p]
+        nes_lib.getMinimalActionSet.restype = None
+        nes_lib.getMinimalActionSet(self.obj, as_ctypes(act))
+        return act
 
     def getFrameNumber(self):
         nes_lib.getFrameNumber.argtypes = [c_void_p]
@@ -106,32 +266,33 @@ class NESInterface(object):
         """
         if(screen_data is None):
             screen_data = np.zeros(self.width*self.height, dtype=np.uint8)
-            
+        if _nes_native is not None:
+            _nes_native.getScreen(self.obj, screen_data)
+            return screen_data
+
         nes_lib.getScreen.argtypes = [c_void_p, c_void_p, c_int]
         nes_lib.getScreen.restype = None
         nes_lib.getScreen(self.obj, as_ctypes(screen_data), c_int(screen_data.size))
         return screen_data
 
-    def getScreenRGB(self, screen_data=None):
+    def getScreenRGB(self, screen_data=None, format=RGB_FORMAT_BGR24):
         """This function fills screen_data with the data in RGB format
         screen_data MUST be a numpy array of uint8. This can be initialized like so:
         screen_data = np.empty((height,width,3), dtype=np.uint8)
+        (or (height,width,4) for RGB_FORMAT_RGBA32).
         If it is None,  then this function will initialize it.
+        The channels are in BGR order unless another format is given.
         """
         if(screen_data is None):
-            screen_data = np.empty((self.height, self.width, 1), dtype=np.uint8)
-        nes_lib.getScreen.argtypes = [c_void_p, c_void_p, c_int]
-        nes_lib.getScreen.restype = None
-
-        # First get the raw screen.
-        nes_lib.getScreen(self.obj, as_ctypes(screen_data), c_int(screen_data.size))
-
-        # Now convert to RGB.
-        rgb_screen = np.empty((self.height, self.width, 3), dtype=np.uint8)
-        nes_lib.fillRGBfromPalette.argtypes = [c_void_p, c_void_p, c_void_p, c_int]
-        nes_lib.fillRGBfromPalette.restype = None
-        nes_lib.fillRGBfromPalette(self.obj, as_ctypes(screen_data), as_ctypes(rgb_screen), c_int(screen_data.size))
-        return rgb_screen
+            channels = 4 if format == RGB_FORMAT_RGBA32 else 3
+            screen_data = np.empty((self.height, self.width, channels), dtype=np.uint8)
+        if _nes_native is not None:
+            _nes_native.getScreenRGB(self.obj, screen_data, format)
+            return screen_data
+        nes_lib.getScreenRGB.argtypes = [c_void_p, c_void_p, c_int, c_int]
+        nes_lib.getScreenRGB.restype = None
+        nes_lib.getScreenRGB(self.obj, as_ctypes(screen_data), c_int(screen_data.size), c_int(format))
+        return screen_data
 
     def getScreenGrayscale(self, screen_data=None):
         """This function fills screen_data with the data in grayscnes
@@ -141,12 +302,65 @@ class NESInterface(object):
         """
         if(screen_data is None):
             screen_data = np.empty((self.height, self.width, 1), dtype=np.uint8)
+        if _nes_native is not None:
+            _nes_native.getScreen(self.obj, screen_data)
+            return screen_data
         nes_lib.getScreen.argtypes = [c_void_p, c_void_p, c_int]
         nes_lib.getScreen.restype = None
         nes_lib.getScreen(self.obj, as_ctypes(screen_data[:]), c_int(screen_data.size))
         return screen_data
 
+    def setObservationFormat(self, width=84, height=84, grayscale=True,
+                             crop_top=0, crop_bottom=0, crop_left=0, crop_right=0):
+        """Sets how getObservation preprocesses the screen: crop the given
+        number of pixels on each side, area-average down to width x height
+        and keep luminance only if grayscale is set, RGB otherwise.
+        Returns False if the crop is smaller than the requested size.
+        """
+        nes_lib.setObservationFormat.argtypes = [c_void_p, c_int, c_int, c_bool, c_int, c_int, c_int, c_int]
+        nes_lib.setObservationFormat.restype = c_bool
+        if not nes_lib.setObservationFormat(self.obj, width, height, grayscale,
+                                            crop_top, crop_bottom, crop_left, crop_right):
+            return False
+        self.obs_shape = (height, width, 1 if grayscale else 3)
+        return True
+
+    def getObservation(self, obs=None):
+        """This function fills obs with the preprocessed screen.
+        obs MUST be a numpy array of uint8 with the shape set by
+        setObservationFormat, (84, 84, 1) unless changed.
+        If it is None,  then this function will initialize it.
+        """
+        if(obs is None):
+            obs = np.empty(self.obs_shape, dtype=np.uint8)
+        if _nes_native is not None:
+            _nes_native.getObservation(self.obj, obs)
+            return obs
+        nes_lib.getObservation.argtypes = [c_void_p, c_void_p, c_int]
+        nes_lib.getObservation.restype = None
+        nes_lib.getObservation(self.obj, as_ctypes(obs), c_int(obs.size))
+        return obs
+
+    def getScreenView(self):
+        """Returns a read-only (height, width) uint8 numpy view of the
+        emulator's frame buffer, the raw pixels getScreen would copy.
+        The view reads the live buffer, so it always shows the latest frame
+        without copying. With several NESInterface objects in one process it
+        shows whichever one ran last; use getScreen there instead.
+        """
+        nes_lib.getScreenBuffer.argtypes = [c_void_p]
+        nes_lib.getScreenBuffer.restype = c_void_p
+        nes_lib.getScreenStride.argtypes = [c_void_p]
+        nes_lib.getScreenStride.restype = c_int
+        stride = nes_lib.getScreenStride(self.obj)
+        buf = (c_uint8 * (stride * self.height)).from_address(nes_lib.getScreenBuffer(self.obj))
+        view = np.ndarray((self.height, self.width), dtype=np.uint8, buffer=buf, strides=(stride, 1))
+        view.flags.writeable = False
+        return view
+
     def getRAMSize(self):
+        nes_lib.getRAMSize.argtypes = [c_void_p]
+        nes_lib.getRAMSize.restype = c_int
         return nes_lib.getRAMSize(self.obj)
 
     def getRAM(self, ram=None):
@@ -157,11 +371,52 @@ class NESInterface(object):
         If it is None,  then this function will initialize it.
         """
         if(ram is None):
-            ram_size = nes_lib.getRAMSize(self.obj)
-            ram = np.zeros(ram_size, dtype=np.uint8)
+            ram = np.zeros(self.getRAMSize(), dtype=np.uint8)
+        nes_lib.getRAM.argtypes = [c_void_p, c_void_p]
+        nes_lib.getRAM.restype = None
         nes_lib.getRAM(self.obj, as_ctypes(ram))
         return ram
 
+    def getRAMView(self):
+        """Returns a read-only uint8 numpy view of the console RAM that
+        follows the emulator without copying. The same caveat as for
+        getScreenView applies when several NESInterface objects are used.
+        """
+        nes_lib.getRAMBuffer.argtypes = [c_void_p]
+        nes_lib.getRAMBuffer.restype = c_void_p
+        buf = (c_uint8 * self.getRAMSize()).from_address(nes_lib.getRAMBuffer(self.obj))
+        view = np.frombuffer(buf, dtype=np.uint8)
+        view.flags.writeable = False
+        return view
+
+    def getSpriteObservation(self, oam=None, line_sprites=None, line_counts=None, scroll=None):
+        """Returns the sprites as fixed-size numpy arrays, for agents that
+        do not need pixels:
+        oam: (64, 4) int32, the object memory as (y, tile, attributes, x)
+            rows, y being the first screen line the sprite covers.
+        line_sprites: (240, 8) uint8, the OAM indices of the sprites the PPU
+            drew on each line of the last frame, 255 in unused slots.
+        line_counts: (240,) uint8, the number of sprites on each line.
+        scroll: (2,) int32, the x and y scroll the last frame started with.
+        Arrays that are None are allocated; pass them back in to reuse them.
+        """
+        if(oam is None):
+            oam = np.zeros((64, 4), dtype=np.int32)
+        if(line_sprites is None):
+            line_sprites = np.zeros((240, 8), dtype=np.uint8)
+        if(line_counts is None):
+            line_counts = np.zeros(240, dtype=np.uint8)
+        if(scroll is None):
+            scroll = np.zeros(2, dtype=np.int32)
+        if _nes_native is not None:
+            _nes_native.getSpriteObservation(self.obj, oam, line_sprites, line_counts, scroll)
+        else:
+            nes_lib.getSpriteObservation.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p, c_void_p]
+            nes_lib.getSpriteObservation.restype = None
+            nes_lib.getSpriteObservation(self.obj, as_ctypes(oam), as_ctypes(line_sprites),
+                                         as_ctypes(line_counts), as_ctypes(scroll))
+        return oam, line_sprites, line_counts, scroll
+
     def saveScreenPNG(self, filename):
         """Save the current screen as a png file"""
         return nes_lib.saveScreenPNG(self.obj, filename)
@@ -178,50 +433,260 @@ class NESInterface(object):
         nes_lib.loadState.restype = c_bool
         return nes_lib.loadState(self.obj)
 
-    def cloneState(self):
-        """This makes a copy of the environment state. This copy does *not*
-        include pseudorandomness, making it suitable for planning
-        purposes. By contrast, see cloneSystemState.
+    def getSnapshotSize(self):
+        """Returns the size in bytes of a state returned by cloneState"""
+        nes_lib.getSnapshotSize.argtypes = [c_void_p]
+        nes_lib.getSnapshotSize.restype = c_int
+        return nes_lib.getSnapshotSize(self.obj)
+
+    def cloneState(self, state=None):
+        """This makes an in-memory copy of the emulator state and returns it
+        as a numpy array of uint8. Nothing is written to disk.
+        state may be a preallocated array of at least getSnapshotSize()
+        bytes, in which case it is filled and returned.
         """
-        return nes_lib.cloneState(self.obj)
+        if(state is None):
+            state = np.empty(self.getSnapshotSize(), dtype=np.uint8)
+        nes_lib.cloneState.argtypes = [c_void_p, c_void_p, c_int]
+        nes_lib.cloneState.restype = c_int
+        size = nes_lib.cloneState(self.obj, as_ctypes(state), c_int(state.size))
+        return state[:size]
 
     def restoreState(self, state):
-        """Reverse operation of cloneState(). This does not restore
-        pseudorandomness, so that repeated calls to restoreState() in
-        the stochastic controls setting will not lead to the same
-        outcomes.  By contrast, see restoreSystemState.
+        """Reverse operation of cloneState(). Returns False if the state
+        could not be loaded.
         """
-        nes_lib.restoreState(self.obj, state)
+        nes_lib.restoreState.argtypes = [c_void_p, c_void_p, c_int]
+        nes_lib.restoreState.restype = c_bool
+        return nes_lib.restoreState(self.obj, as_ctypes(state), c_int(state.size))
+
+    def cloneDeltaState(self, parent=None, screen=False):
+        """Takes an in-memory snapshot that only stores what changed since
+        parent, a DeltaState from an earlier call (or None for a full one).
+        Children of one node in a search tree share everything they did not
+        change, so each costs a small fraction of cloneState. The screen is
+        only kept, as a full copy, if screen is True. The snapshot is freed
+        when the returned object is garbage collected.
+        """
+        nes_lib.cloneDeltaState.argtypes = [c_void_p, c_void_p, c_bool]
+        nes_lib.cloneDeltaState.restype = c_void_p
+        return DeltaState(nes_lib.cloneDeltaState(self.obj, parent.handle if parent is not None else None, screen))
+
+    def restoreDeltaState(self, state):
+        """Reverse operation of cloneDeltaState(). The screen is blank
+        until the next frame if the state was taken without it. Returns
+        False if the state could not be loaded.
+        """
+        nes_lib.restoreDeltaState.argtypes = [c_void_p, c_void_p]
+        nes_lib.restoreDeltaState.restype = c_bool
+        return nes_lib.restoreDeltaState(self.obj, state.handle)
 
     def cloneSystemState(self):
-        """This makes a copy of the system & environment state, suitable for
-        serialization. This includes pseudorandomness and so is *not*
-        suitable for planning purposes.
+        """States already carry the episode's sticky-action randomness
+        and last actions along with the emulated system, so this is the
+        same as cloneState().
         """
-        return nes_lib.cloneSystemState(self.obj)
+        return self.cloneState()
 
     def restoreSystemState(self, state):
-        """Reverse operation of cloneSystemState."""
-        nes_lib.restoreSystemState(self.obj, state)
+        """Reverse operation of cloneSystemState()."""
+        return self.restoreState(state)
 
     def deleteState(self, state):
-        """ Deallocates the NESState """
-        nes_lib.deleteState(state)
+        """States are plain numpy arrays, so there is nothing to free"""
+        pass
 
     def encodeStateLen(self, state):
-        return nes_lib.encodeStateLen(state)
+        return state.size
 
     def encodeState(self, state, buf=None):
-        if buf == None:
-            length = nes_lib.encodeStateLen(state)
-            buf = np.zeros(length, dtype=np.uint8)
-        nes_lib.encodeState(state, as_ctypes(buf), c_int(len(buf)))
+        if buf is None:
+            return state.copy()
+        buf[:state.size] = state
         return buf
 
     def decodeState(self, serialized):
-        return nes_lib.decodeState(as_ctypes(serialized), len(serialized))
+        return np.asarray(serialized, dtype=np.uint8)
 
     def __del__(self):
         nes_lib.delete_NES.argtypes = [c_void_p]
         nes_lib.delete_NES.restype = None
         nes_lib.delete_NES(self.obj)
+
+
+class DeltaState(object):
+    """A snapshot returned by NESInterface.cloneDeltaState."""
+    def __init__(self, handle):
+        self.handle = handle
+
+    def memory(self):
+        """Returns the bytes held by this snapshot alone."""
+        nes_lib.getDeltaStateMemory.argtypes = [c_void_p]
+        nes_lib.getDeltaStateMemory.restype = c_int
+        return nes_lib.getDeltaStateMemory(self.handle)
+
+    def __del__(self):
+        nes_lib.releaseDeltaState.argtypes = [c_void_p]
+        nes_lib.releaseDeltaState.restype = None
+        nes_lib.releaseDeltaState(self.handle)
+
+
+class NESVectorEnv(object):
+    """Steps a batch of environments running the same ROM with one call.
+    The environments run in parallel in num_workers worker processes, one
+    per environment by default; environments sharing a worker take turns.
+    Rewards, done flags and raw screens are written into arrays that are
+    allocated once and reused for every step. Raises RuntimeError if the
+    workers cannot all be started.
+    """
+    def __init__(self, rom, num_envs, num_workers=0):
+        nes_lib.NESVectorEnv.argtypes = [c_char_p, c_int, c_int]
+        nes_lib.NESVectorEnv.restype = c_void_p
+        self.obj = nes_lib.NESVectorEnv(rom.encode('utf-8'), num_envs, num_workers)
+        nes_lib.vectorIsReady.argtypes = [c_void_p]
+        nes_lib.vectorIsReady.restype = c_bool
+        if not nes_lib.vectorIsReady(self.obj):
+            raise RuntimeError('NESVectorEnv could not map its shared memory or start its workers')
+        nes_lib.getNumEnvs.argtypes = [c_void_p]
+        nes_lib.getNumEnvs.restype = c_int
+        nes_lib.getBatchScreenSize.argtypes = [c_void_p]
+        nes_lib.getBatchScreenSize.restype = c_int
+        self.num_envs = nes_lib.getNumEnvs(self.obj)
+        self.screen_size = nes_lib.getBatchScreenSize(self.obj)
+        self.rewards = np.zeros(self.num_envs, dtype=np.intc)
+        self.dones = np.zeros(self.num_envs, dtype=np.bool_)
+        self.screens = np.zeros((self.num_envs, self.screen_size), dtype=np.uint8)
+        self.env_ids = np.zeros(self.num_envs, dtype=np.intc)
+
+    def reset_all(self):
+        if _nes_native is not None:
+            return _nes_native.resetAll(self.obj)
+        nes_lib.resetAll.argtypes = [c_void_p]
+        nes_lib.resetAll.restype = None
+        nes_lib.resetAll(self.obj)
+
+    def act(self, actions, with_screens=True):
+        """Applies actions[i] to environment i and returns the tuple
+        (rewards, dones, screens). The returned arrays are overwritten by
+        the next call; screens is None if with_screens is False. Raises
+        RuntimeError if a worker process has died.
+        """
+        actions = np.ascontiguousarray(actions, dtype=np.intc)
+        if _nes_native is not None:
+            ok = _nes_native.actBatch(self.obj, actions, self.rewards, self.dones,
+                                      self.screens if with_screens else None)
+        else:
+            nes_lib.actBatch.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p, c_void_p]
+            nes_lib.actBatch.restype = c_bool
+            screens = self.screens.ctypes.data if with_screens else None
+            ok = nes_lib.actBatch(self.obj, actions.ctypes.data, self.rewards.ctypes.data,
+                                  self.dones.ctypes.data, screens)
+        if not ok:
+            raise RuntimeError('a NESVectorEnv worker has died')
+        return self.rewards, self.dones, self.screens if with_screens else None
+
+    def send(self, env_ids, actions):
+        """Starts applying actions[i] to environment env_ids[i] in the
+        background and returns at once, so the next actions can be computed
+        while the emulator runs. ACT_RESET (15) resets an environment
+        instead. An environment must be received before it is sent to again.
+        """
+        env_ids = np.ascontiguousarray(env_ids, dtype=np.intc)
+        actions = np.ascontiguousarray(actions, dtype=np.intc)
+        if env_ids.size != actions.size:
+            raise ValueError('env_ids and actions differ in length')
+        if _nes_native is not None:
+            return _nes_native.sendBatch(self.obj, env_ids, actions)
+        nes_lib.sendBatch.argtypes = [c_void_p, c_void_p, c_void_p, c_int]
+        nes_lib.sendBatch.restype = None
+        nes_lib.sendBatch(self.obj, env_ids.ctypes.data, actions.ctypes.data, env_ids.size)
+
+    def recv(self, min_count=1, with_screens=True):
+        """Waits for at least min_count sent actions to finish (fewer if no
+        more are outstanding) and returns the tuple (env_ids, rewards,
+        dones, screens) for all the finished ones, in the order they
+        finished. The arrays are overwritten by the next act or recv call;
+        screens is None if with_screens is False.
+        """
+        if _nes_native is not None:
+            count = _nes_native.recvBatch(self.obj, self.env_ids, self.rewards, self.dones,
+                                          self.screens if with_screens else None, min_count)
+        else:
+            nes_lib.recvBatch.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p, c_void_p, c_int, c_int]
+            nes_lib.recvBatch.restype = c_int
+            screens = self.screens.ctypes.data if with_screens else None
+            count = nes_lib.recvBatch(self.obj, self.env_ids.ctypes.data, self.rewards.ctypes.data,
+                                      self.dones.ctypes.data, screens, self.num_envs, min_count)
+        return (self.env_ids[:count], self.rewards[:count], self.dones[:count],
+                self.screens[:count] if with_screens else None)
+
+    def __del__(self):
+        nes_lib.delete_NESVectorEnv.argtypes = [c_void_p]
+        nes_lib.delete_NESVectorEnv.restype = None
+        nes_lib.delete_NESVectorEnv(self.obj)
+
+
+class NESForkServer(object):
+    """Steps a batch of environments, each in its own process forked from
+    one that has already loaded and reset the ROM, so startup costs one
+    boot however many environments there are. Results land in shared
+    memory; rewards, dones and frames are numpy views of it, updated in
+    place by every step. Frames are raw screens, or observations if
+    obs_width is given (see NESInterface.setObservationFormat). Raises
+    RuntimeError if the workers cannot all be started.
+    """
+    def __init__(self, rom, num_envs, obs_width=0, obs_height=0, grayscale=True):
+        nes_lib.NESForkServer.argtypes = [c_char_p, c_int, c_int, c_int, c_bool]
+        nes_lib.NESForkServer.restype = c_void_p
+        self.obj = nes_lib.NESForkServer(rom.encode('utf-8'), num_envs, obs_width, obs_height, grayscale)
+        nes_lib.forkIsReady.argtypes = [c_void_p]
+        nes_lib.forkIsReady.restype = c_bool
+        if not nes_lib.forkIsReady(self.obj):
+            raise RuntimeError('NESForkServer could not map its shared memory or start all %d workers' % num_envs)
+        nes_lib.getForkNumEnvs.argtypes = [c_void_p]
+        nes_lib.getForkNumEnvs.restype = c_int
+        nes_lib.getForkFrameSize.argtypes = [c_void_p]
+        nes_lib.getForkFrameSize.restype = c_int
+        nes_lib.getForkRewards.argtypes = [c_void_p]
+        nes_lib.getForkRewards.restype = c_void_p
+        nes_lib.getForkDones.argtypes = [c_void_p]
+        nes_lib.getForkDones.restype = c_void_p
+        nes_lib.getForkFrames.argtypes = [c_void_p]
+        nes_lib.getForkFrames.restype = c_void_p
+        self.num_envs = nes_lib.getForkNumEnvs(self.obj)
+        self.frame_size = nes_lib.getForkFrameSize(self.obj)
+        n = self.num_envs
+        self.rewards = np.frombuffer((c_int * n).from_address(nes_lib.getForkRewards(self.obj)), dtype=np.intc)
+        self.dones = np.frombuffer((c_bool * n).from_address(nes_lib.getForkDones(self.obj)), dtype=np.bool_)
+        frames = (c_uint8 * (n * self.frame_size)).from_address(nes_lib.getForkFrames(self.obj))
+        self.frames = np.frombuffer(frames, dtype=np.uint8).reshape(n, self.frame_size)
+        for view in (self.rewards, self.dones, self.frames):
+            view.flags.writeable = False
+
+    def reset_all(self):
+        if _nes_native is not None:
+            return _nes_native.forkResetAll(self.obj)
+        nes_lib.forkResetAll.argtypes = [c_void_p]
+        nes_lib.forkResetAll.restype = None
+        nes_lib.forkResetAll(self.obj)
+
+    def act(self, actions):
+        """Applies actions[i] to environment i and returns the tuple
+        (rewards, dones, frames). Raises RuntimeError if a worker process
+        has died.
+        """
+        actions = np.ascontiguousarray(actions, dtype=np.intc)
+        if _nes_native is not None:
+            ok = _nes_native.forkAct(self.obj, actions)
+        else:
+            nes_lib.forkAct.argtypes = [c_void_p, c_void_p]
+            nes_lib.forkAct.restype = c_bool
+            ok = nes_lib.forkAct(self.obj, actions.ctypes.data)
+        if not ok:
+            raise RuntimeError('a NESForkServer worker has died')
+        return self.rewards, self.dones, self.frames
+
+    def __del__(self):
+        nes_lib.delete_NESForkServer.argtypes = [c_void_p]
+        nes_lib.delete_NESForkServer.restype = None
+        nes_lib.delete_NESForkServer(self.obj)
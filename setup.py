@@ -1,4 +1,4 @@
-from distutils.core import setup
+from distutils.core import setup, Extension
 import os.path, sys
 
 nes_c_lib = 'nes_python_interface/libfceux.so'
@@ -7,6 +7,15 @@ if not os.path.isfile(nes_c_lib):
     'built the FCEUX Learning Environment using scons.'%(nes_c_lib))
   sys.exit()
 
+# Per-step calls, bound natively instead of through ctypes. It links
+# against the libfceux.so shipped next to it.
+nes_native = Extension('nes_python_interface._nes_native',
+      sources=['nes_python_interface/nes_native.cpp'],
+      include_dirs=['src'],
+      library_dirs=['nes_python_interface'],
+      libraries=['fceux'],
+      runtime_library_dirs=['$ORIGIN'])
+
 setup(name = 'nes_python_interface',
       version='0.0.1',
       description = 'FCEUX Learning Environment Python Interface',
@@ -15,6 +24,7 @@ setup(name = 'nes_python_interface',
       license='GPL',
       packages=['nes_python_interface'],
       package_dir={'nes_python_interface': 'nes_python_interface'},
-      package_data={'nes_python_interface': ['libfceux.so']})
+      ext_modules=[nes_native],
+      package_data={'nes_python_interface': ['libfceux.so', 'games/*.game']})
 
 
@@ -90,6 +90,7 @@ static INLINE void setpageptr(int s, uint32 A, uint8 *p, int ram) {
 			PRGIsRAM[AB + x] = 0;
 			Page[AB + x] = 0;
 		}
+	UpdatePRGReadPages(A, A + (s << 10) - 1);
 }
 
 static uint8 nothing[8192];
@@ -103,6 +104,7 @@ void ResetCartMapping(void) {
 		PRGptr[x] = CHRptr[x] = 0;
 		PRGsize[x] = CHRsize[x] = 0;
 	}
+	UpdatePRGReadPages(0, 0xFFFF);
 	for (x = 0; x < 8; x++) {
 		MMC5SPRVPage[x] = MMC5BGVPage[x] = VPageR[x] = nothing - 0x400 * x;
 	}
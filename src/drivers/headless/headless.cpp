@@ -0,0 +1,188 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "headless.h"
+
+#include "../../fceu.h"
+#include "../../types.h"
+#include "../../version.h"
+
+#include <cstring>
+#include <cstdio>
+#include <sys/time.h>
+
+int noGui = 1;
+int isloaded;
+
+bool turbo = false;
+
+int closeFinishedMovie = 0;
+
+int pal_emulation;
+int dendy;
+bool swapDuty;
+
+// The palette is only kept here so the learning interface can turn
+// indexed pixels into RGB.
+static struct {
+	uint8 r, g, b;
+} s_palette[256];
+
+/**
+ * Loads a game and applies the core settings the SDL driver would take
+ * from its default configuration.
+ */
+int LoadGame(const char *path)
+{
+	if (isloaded) {
+		CloseGame();
+	}
+	if (!FCEUI_LoadGame(path, 1)) {
+		return 0;
+	}
+
+	FCEUI_SetRegion(0);
+	FCEUI_SetGameGenie(0);
+	FCEUI_SetLowPass(0);
+	FCEUI_DisableSpriteLimitation(1);
+	FCEUI_SetRenderedLines(8, 231, 0, 239);
+
+	// Nobody listens, so leave the sound rate at 0.
+	FCEUI_Sound(0);
+
+	isloaded = 1;
+	return 1;
+}
+
+/**
+ * Closes a game.
+ */
+int CloseGame()
+{
+	if (!isloaded) {
+		return 0;
+	}
+	FCEUI_CloseGame();
+	isloaded = 0;
+	GameInfo = 0;
+	return 1;
+}
+
+/**
+ * There is no video, audio or input backend to update.
+ */
+void FCEUD_Update(uint8 *XBuf, int32 *Buffer, int Count)
+{
+}
+
+uint64 FCEUD_GetTime()
+{
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return (uint64) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+uint64 FCEUD_GetTimeFreq(void)
+{
+	return 1000;
+}
+
+void FCEUD_SetPalette(uint8 index, uint8 r, uint8 g, uint8 b)
+{
+	s_palette[index].r = r;
+	s_palette[index].g = g;
+	s_palette[index].b = b;
+}
+
+void FCEUD_GetPalette(uint8 index, uint8 *r, uint8 *g, uint8 *b)
+{
+	*r = s_palette[index].r;
+	*g = s_palette[index].g;
+	*b = s_palette[index].b;
+}
+
+EMUFILE_FILE* FCEUD_UTF8_fstream(const char *fn, const char *m)
+{
+	return new EMUFILE_FILE(fn, m);
+}
+
+FILE *FCEUD_UTF8fopen(const char *fn, const char *mode)
+{
+	return fopen(fn, mode);
+}
+
+static char *s_headlessCompilerString = "g++ " __VERSION__;
+const char *FCEUD_GetCompilerString()
+{
+	return (const char *)s_headlessCompilerString;
+}
+
+void FCEUD_Message(const char *text)
+{
+	fputs(text, stdout);
+}
+
+void FCEUD_PrintError(const char *errormsg)
+{
+	fprintf(stderr, "%s\n", errormsg);
+}
+
+// There is no network, keyboard, mouse or recorder either.
+int FCEUD_SendData(void *data, uint32 len) { return 0; }
+int FCEUD_RecvData(void *data, uint32 len) { return 0; }
+void FCEUD_NetplayText(uint8 *text) { }
+void FCEUD_NetworkClose(void) { }
+
+unsigned int *GetKeyboard(void)
+{
+	static unsigned int keys[256];
+	return keys;
+}
+
+void GetMouseData(uint32 (&d)[3])
+{
+	d[0] = d[1] = d[2] = 0;
+}
+
+void FCEUD_SetInput(bool fourscore, bool microphone, ESI port0, ESI port1, ESIFC fcexp) { }
+void FCEUI_UseInputPreset(int preset) { }
+bool FCEUD_ShouldDrawInputAids() { return false; }
+void FCEUD_SetEmulationSpeed(int cmd) { }
+void RefreshThrottleFPS() { }
+void FCEUD_VideoChanged() { }
+void FCEUD_SoundToggle(void) { }
+void FCEUD_SoundVolumeAdjust(int n) { }
+void FCEUD_SaveStateAs(void) { }
+void FCEUD_LoadStateFrom(void) { }
+void FCEUD_MovieRecordTo(void) { }
+void FCEUD_MovieReplayFrom(void) { }
+void FCEUD_HideMenuToggle(void) { }
+void FCEUD_ToggleStatusIcon(void) { }
+int FCEUD_ShowStatusIcon(void) { return 0; }
+bool FCEUD_PauseAfterPlayback() { return false; }
+void FCEUD_TurboOn(void) { }
+void FCEUD_TurboOff(void) { }
+void FCEUD_TurboToggle(void) { }
+void FCEUD_AviRecordTo(void) { }
+void FCEUD_AviStop(void) { }
+void FCEUI_AviVideoUpdate(const unsigned char* buffer) { }
+bool FCEUI_AviIsRecording(void) { return false; }
+bool FCEUI_AviEnableHUDrecording() { return false; }
+bool FCEUI_AviDisableMovieMessages() { return false; }
+FCEUFILE* FCEUD_OpenArchiveIndex(ArchiveScanRecord& asr, std::string &fname, int innerIndex) { return 0; }
+FCEUFILE* FCEUD_OpenArchive(ArchiveScanRecord& asr, std::string& fname, std::string* innerFilename) { return 0; }
+ArchiveScanRecord FCEUD_ScanArchive(std::string fname) { return ArchiveScanRecord(); }
@@ -0,0 +1,21 @@
+#ifndef __FCEU_HEADLESS_H
+#define __FCEU_HEADLESS_H
+
+#include "../../driver.h"
+
+// Driver for the learning library that has no video, audio or input
+// backend. Every FCEUD_* callback is a no-op or a minimal stand-in.
+
+extern int noGui;
+extern int isloaded;
+
+extern int dendy;
+extern int pal_emulation;
+extern bool swapDuty;
+
+int LoadGame(const char *path);
+int CloseGame(void);
+void FCEUD_Update(uint8 *XBuf, int32 *Buffer, int Count);
+uint64 FCEUD_GetTime();
+
+#endif
@@ -74,6 +74,8 @@ extern void RefreshThrottleFPS();
 #include "drivers/win/ramwatch.h"
 #include "drivers/win/memwatch.h"
 #include "drivers/win/tracer.h"
+#elif defined(HEADLESS)
+#include "drivers/headless/headless.h"
 #else
 #include "drivers/sdl/sdl.h"
 #endif
@@ -230,6 +232,8 @@ void (*GameStateRestore)(int version);
 
 readfunc ARead[0x10000];
 writefunc BWrite[0x10000];
+uint8 *AReadPage[0x100];
+static uint8 AReadPageIsPRG[0x100];
 static readfunc *AReadG;
 static writefunc *BWriteG;
 static int RWWrap = 0;
@@ -287,6 +291,7 @@ void FlushGenieRW(void) {
 		AReadG = NULL;
 		BWriteG = NULL;
 		RWWrap = 0;
+		UpdateReadPages(0x8000, 0xFFFF);
 	}
 }
 
@@ -313,6 +318,41 @@ void SetReadHandler(int32 start, int32 end, readfunc func) {
 	else
 		for (x = end; x >= start; x--)
 			ARead[x] = func;
+	UpdateReadPages(start, end);
+}
+
+static DECLFR(ARAML);
+static DECLFR(ARAMH);
+
+//Finds the pages read through a single RAM or PRG handler, which the CPU can
+//read directly. Must follow any change to ARead.
+void UpdateReadPages(int32 start, int32 end) {
+	int32 p, x;
+
+	for (p = start >> 8; p <= (end >> 8); p++) {
+		readfunc func = ARead[p << 8];
+		for (x = 1; x < 0x100 && ARead[(p << 8) + x] == func; x++);
+
+		AReadPage[p] = NULL;
+		AReadPageIsPRG[p] = 0;
+		if (x < 0x100)
+			continue;
+		if (func == ARAML || func == ARAMH)
+			AReadPage[p] = RAM + ((p << 8) & 0x7FF) - (p << 8);
+		else if (func == CartBR || func == CartBROB) {
+			AReadPageIsPRG[p] = 1;
+			AReadPage[p] = Page[p >> 3];
+		}
+	}
+}
+
+//Follows a change of Page for the pages read through CartBR.
+void UpdatePRGReadPages(int32 start, int32 end) {
+	int32 p;
+
+	for (p = start >> 8; p <= (end >> 8); p++)
+		if (AReadPageIsPRG[p])
+			AReadPage[p] = Page[p >> 3];
 }
 
 writefunc GetWriteHandler(int32 a) {
@@ -778,7 +818,20 @@ void ResetNES(void) {
 	memset(XBackBuf, 0, 256 * 256);
 }
 
+uint32 FCEU_MemoryRandSeed = 0;
+
 void FCEU_MemoryRand(uint8 *ptr, uint32 size) {
+	if (FCEU_MemoryRandSeed) {
+		//xorshift32, so a seed always gives the same contents
+		uint32 x = FCEU_MemoryRandSeed;
+		while (size--) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			*ptr++ = (uint8)x;
+		}
+		return;
+	}
 	int x = 0;
 	while (size) {
 		*ptr = (x & 4) ? 0xFF : 0x00;	// Huang Di DEBUG MODE enabled by default
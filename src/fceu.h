@@ -20,6 +20,8 @@ extern char romNameWhenClosingEmulator[];
 #define DECLFR(x) uint8 x (uint32 A)
 #define DECLFW(x) void x (uint32 A, uint8 V)
 
+//Seeds the pattern FCEU_MemoryRand fills memory with; 0 keeps the fixed one.
+extern uint32 FCEU_MemoryRandSeed;
 void FCEU_MemoryRand(uint8 *ptr, uint32 size);
 void SetReadHandler(int32 start, int32 end, readfunc func);
 void SetWriteHandler(int32 start, int32 end, writefunc func);
@@ -66,6 +68,13 @@ void FCEU_WriteRomByte(uint32 i, uint8 value);
 extern readfunc ARead[0x10000];
 extern writefunc BWrite[0x10000];
 
+//Direct pointers for the 256 byte pages whose reads are plain memory (RAM and
+//PRG mapped by setprg*), indexed like Page: AReadPage[A >> 8][A]. NULL pages
+//have to go through ARead.
+extern uint8 *AReadPage[0x100];
+void UpdateReadPages(int32 start, int32 end);
+void UpdatePRGReadPages(int32 start, int32 end);
+
 enum GI {
 	GI_RESETM2	=1,
 	GI_POWER =2,
@@ -0,0 +1,105 @@
+#include "nes_delta_snapshot.hpp"
+#include <string.h>
+
+namespace nes {
+
+// Granularity of the comparison. Small enough that a changed RAM byte
+// costs little, large enough to keep the index short.
+static const size_t BLOCK_SIZE = 64;
+
+// A snapshot becomes a keyframe itself once more than this fraction of
+// its blocks (1/n) differ from its parent's keyframe.
+static const size_t MAX_CHANGED_FRACTION = 4;
+
+DeltaSnapshot::DeltaSnapshot() :
+    m_keyframe(NULL),
+    m_size(0),
+    m_refs(1)
+{
+}
+
+DeltaSnapshot::~DeltaSnapshot() {
+	if (m_keyframe) {
+		m_keyframe->release();
+	}
+}
+
+DeltaSnapshot *DeltaSnapshot::create(const unsigned char *state, size_t size, DeltaSnapshot *parent,
+		const unsigned char *screen, size_t screen_size) {
+
+	DeltaSnapshot *snapshot = new DeltaSnapshot();
+	snapshot->m_size = size;
+	if (screen) {
+		snapshot->m_screen.assign(screen, screen + screen_size);
+	}
+
+	DeltaSnapshot *keyframe = parent ? (parent->m_keyframe ? parent->m_keyframe : parent) : NULL;
+	if (keyframe && keyframe->m_size == size) {
+		const unsigned char *base = &keyframe->m_data[0];
+		size_t num_blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		size_t max_changed = num_blocks / MAX_CHANGED_FRACTION;
+
+		for (size_t i = 0; i < num_blocks && snapshot->m_blocks.size() <= max_changed; i++) {
+			size_t offset = i * BLOCK_SIZE;
+			size_t len = size - offset < BLOCK_SIZE ? size - offset : BLOCK_SIZE;
+			if (memcmp(state + offset, base + offset, len) != 0) {
+				snapshot->m_blocks.push_back(i);
+				snapshot->m_data.insert(snapshot->m_data.end(), state + offset, state + offset + len);
+			}
+		}
+
+		if (snapshot->m_blocks.size() <= max_changed) {
+			std::vector<unsigned char>(snapshot->m_data).swap(snapshot->m_data);
+			std::vector<unsigned int>(snapshot->m_blocks).swap(snapshot->m_blocks);
+			keyframe->retain();
+			snapshot->m_keyframe = keyframe;
+			return snapshot;
+		}
+		snapshot->m_blocks.clear();
+	}
+
+	snapshot->m_data.assign(state, state + size);
+	return snapshot;
+}
+
+void DeltaSnapshot::retain() {
+	m_refs++;
+}
+
+void DeltaSnapshot::release() {
+	if (--m_refs == 0) {
+		delete this;
+	}
+}
+
+void DeltaSnapshot::materialize(std::vector<unsigned char> &out) const {
+
+	if (!m_keyframe) {
+		out = m_data;
+		return;
+	}
+
+	out = m_keyframe->m_data;
+	const unsigned char *data = m_data.empty() ? NULL : &m_data[0];
+	for (size_t i = 0; i < m_blocks.size(); i++) {
+		size_t offset = m_blocks[i] * BLOCK_SIZE;
+		size_t len = m_size - offset < BLOCK_SIZE ? m_size - offset : BLOCK_SIZE;
+		memcpy(&out[offset], data, len);
+		data += len;
+	}
+}
+
+size_t DeltaSnapshot::getSize() const {
+	return m_size;
+}
+
+const std::vector<unsigned char> &DeltaSnapshot::getScreen() const {
+	return m_screen;
+}
+
+size_t DeltaSnapshot::getMemoryUsage() const {
+	return sizeof(*this) + m_data.capacity() + m_blocks.capacity() * sizeof(unsigned int) +
+		m_screen.capacity();
+}
+
+} // namespace nes
@@ -0,0 +1,68 @@
+#ifndef __NES_DELTA_SNAPSHOT_HPP__
+#define __NES_DELTA_SNAPSHOT_HPP__
+
+#include <vector>
+#include <stddef.h>
+
+namespace nes {
+
+// A serialized emulator state stored as the blocks that differ from a
+// keyframe, a full state shared by all snapshots taken from it. Snapshots
+// taken one after another in a search tree mostly differ in a few RAM
+// bytes and registers, so siblings share everything else. The screen
+// changes wholesale whenever the game scrolls, so it is kept out of the
+// comparison and stored apart, in full, only for snapshots that ask.
+// Snapshots are reference counted and not thread safe; NESInterface
+// serializes access to them.
+class DeltaSnapshot {
+
+    public:
+
+        /** Stores state as a difference to parent's keyframe, or as a new
+            keyframe if there is no parent, the layout differs or too much
+            changed. If screen is not NULL, screen_size bytes of it are
+            stored alongside. The result has one reference. */
+        static DeltaSnapshot *create(const unsigned char *state, size_t size, DeltaSnapshot *parent,
+                const unsigned char *screen = NULL, size_t screen_size = 0);
+
+        /** Adds a reference. */
+        void retain();
+
+        /** Drops a reference, deleting the snapshot when none are left. */
+        void release();
+
+        /** Rebuilds the full state into out. */
+        void materialize(std::vector<unsigned char> &out) const;
+
+        /** Returns the size of the full state. */
+        size_t getSize() const;
+
+        /** Returns the screen stored with the snapshot, empty if none. */
+        const std::vector<unsigned char> &getScreen() const;
+
+        /** Returns the bytes held by this snapshot alone, excluding its
+            keyframe. */
+        size_t getMemoryUsage() const;
+
+    private:
+
+        DeltaSnapshot();
+        ~DeltaSnapshot();
+
+        /** Copying is explicitly disallowed. */
+        DeltaSnapshot(const DeltaSnapshot &);
+
+        /** Assignment is explicitly disallowed. */
+        DeltaSnapshot &operator=(const DeltaSnapshot &);
+
+        DeltaSnapshot *m_keyframe;          // Full state this one differs from, NULL for keyframes
+        std::vector<unsigned char> m_data;  // The full state, or the changed blocks one after another
+        std::vector<unsigned int> m_blocks; // Index of each changed block
+        std::vector<unsigned char> m_screen; // Screen kept apart from the diff, if asked for
+        size_t m_size;
+        int m_refs;
+};
+
+} // namespace nes
+
+#endif // __NES_DELTA_SNAPSHOT_HPP__
@@ -0,0 +1,340 @@
+#include "nes_fork_server.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+namespace nes {
+
+class NESForkServer::Impl {
+
+    public:
+
+        Impl(const std::string &rom_file, int num_envs, int obs_width, int obs_height, bool grayscale);
+        ~Impl();
+
+        bool isReady() const;
+        int getNumEnvs() const;
+        int getFrameSize() const;
+        void resetAll();
+        bool act(const int *actions);
+        const int *getRewards() const;
+        const bool *getDones() const;
+        const unsigned char *getFrames() const;
+
+    private:
+
+        enum Command {
+            CMD_ACT,
+            CMD_RESET,
+            CMD_QUIT
+        };
+
+        // Per worker part of the slab.
+        struct Slot {
+            sem_t start;   // Posted by the server when a command is ready
+            int command;
+            int action;
+        };
+
+        // Main loop of the worker processes. Never returns.
+        void workerMain(int index);
+
+        // Sends a command to every worker and waits for them to finish.
+        bool dispatch(Command command, const int *actions);
+
+        // Returns false if a worker process has exited.
+        bool checkWorkers();
+
+        NESInterface *m_env;      // The warm environment the workers are forked from
+        bool m_observations;      // Frames are observations rather than screens
+        int m_frame_size;
+        std::vector<pid_t> m_pids;
+        bool m_failed;            // A worker died; no more steps are possible
+
+        // The slab and the pieces it is cut into.
+        unsigned char *m_slab;
+        size_t m_slab_size;
+        sem_t *m_done;            // Posted by each worker when it finishes a command
+        Slot *m_slots;
+        int *m_rewards;
+        bool *m_dones;
+        unsigned char *m_frames;
+};
+
+// Rounds a slab offset up to a cache line.
+static size_t alignSlab(size_t offset) {
+	return (offset + 63) & ~(size_t) 63;
+}
+
+NESForkServer::Impl::Impl(const std::string &rom_file, int num_envs, int obs_width, int obs_height, bool grayscale) :
+    m_env(NULL),
+    m_observations(false),
+    m_frame_size(0),
+    m_failed(false),
+    m_slab(NULL),
+    m_slab_size(0),
+    m_done(NULL),
+    m_slots(NULL),
+    m_rewards(NULL),
+    m_dones(NULL),
+    m_frames(NULL)
+{
+	if (num_envs < 1) {
+		printf("ERROR: NESForkServer needs at least one environment.\n");
+		num_envs = 1;
+	}
+
+	// Load, boot and reset once; the workers start from here.
+	m_env = new NESInterface(rom_file);
+	if (obs_width > 0) {
+		m_observations = m_env->setObservationFormat(obs_width, obs_height, grayscale);
+		if (!m_observations) {
+			printf("ERROR: Invalid observation format, using raw screens.\n");
+		}
+	}
+	m_frame_size = m_observations ? m_env->getObservationSize()
+	                              : m_env->getScreenWidth() * m_env->getScreenHeight();
+	m_env->resetGame();
+
+	size_t done_offset = 0;
+	size_t slots_offset = alignSlab(done_offset + sizeof(sem_t));
+	size_t rewards_offset = alignSlab(slots_offset + num_envs * sizeof(Slot));
+	size_t dones_offset = alignSlab(rewards_offset + num_envs * sizeof(int));
+	size_t frames_offset = alignSlab(dones_offset + num_envs * sizeof(bool));
+	m_slab_size = frames_offset + (size_t) num_envs * m_frame_size;
+
+	void *slab = mmap(NULL, m_slab_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (slab == MAP_FAILED) {
+		printf("ERROR: Could not map %lu bytes of shared memory.\n", (unsigned long) m_slab_size);
+		m_slab_size = 0;
+		m_failed = true;
+		return;
+	}
+	m_slab = (unsigned char *) slab;
+	m_done = (sem_t *) (m_slab + done_offset);
+	m_slots = (Slot *) (m_slab + slots_offset);
+	m_rewards = (int *) (m_slab + rewards_offset);
+	m_dones = (bool *) (m_slab + dones_offset);
+	m_frames = m_slab + frames_offset;
+
+	sem_init(m_done, 1, 0);
+	for (int i = 0; i < num_envs; i++) {
+		sem_init(&m_slots[i].start, 1, 0);
+	}
+
+	// Anything still buffered would be printed again by every worker.
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t parent = getpid();
+	for (int i = 0; i < num_envs; i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			// Die with the server even if it never runs its destructor. If
+			// it is already gone, the signal will not come.
+			prctl(PR_SET_PDEATHSIG, SIGKILL);
+			if (getppid() != parent) {
+				_exit(0);
+			}
+			workerMain(i);
+		}
+		if (pid < 0) {
+			printf("ERROR: Could not fork NESForkServer worker %d.\n", i);
+			m_failed = true;
+			break;
+		}
+		m_pids.push_back(pid);
+	}
+}
+
+NESForkServer::Impl::~Impl() {
+
+	for (int i = 0; i < (int) m_pids.size(); i++) {
+		if (m_pids[i] > 0) {
+			m_slots[i].command = CMD_QUIT;
+			sem_post(&m_slots[i].start);
+		}
+	}
+	for (int i = 0; i < (int) m_pids.size(); i++) {
+		if (m_pids[i] > 0) {
+			waitpid(m_pids[i], NULL, 0);
+		}
+	}
+
+	if (m_slab) {
+		for (int i = 0; i < (int) m_pids.size(); i++) {
+			sem_destroy(&m_slots[i].start);
+		}
+		sem_destroy(m_done);
+		munmap(m_slab, m_slab_size);
+	}
+	delete m_env;
+}
+
+void NESForkServer::Impl::workerMain(int index) {
+
+	Slot *slot = &m_slots[index];
+	unsigned char *frame = m_frames + (size_t) index * m_frame_size;
+
+	// The workers are copies of one environment; give each its own episodes.
+	m_env->setSeed(index + 1);
+
+	for (;;) {
+		while (sem_wait(&slot->start) != 0 && errno == EINTR) {
+		}
+
+		switch (slot->command) {
+
+			case CMD_ACT:
+				m_rewards[index] = m_env->act(slot->action);
+				break;
+
+			case CMD_RESET:
+				m_env->resetGame();
+				m_rewards[index] = 0;
+				break;
+
+			default:
+				// Skip destructors; they belong to the server process.
+				_exit(0);
+		}
+
+		m_dones[index] = m_env->gameOver();
+		if (m_observations) {
+			m_env->getObservation(frame, m_frame_size);
+		} else {
+			m_env->getScreen(frame, m_frame_size);
+		}
+		sem_post(m_done);
+	}
+}
+
+bool NESForkServer::Impl::checkWorkers() {
+
+	bool alive = true;
+	for (int i = 0; i < (int) m_pids.size(); i++) {
+		if (m_pids[i] > 0 && waitpid(m_pids[i], NULL, WNOHANG) == m_pids[i]) {
+			printf("ERROR: NESForkServer worker %d exited.\n", i);
+			m_pids[i] = -1;
+			alive = false;
+		}
+	}
+	return alive;
+}
+
+bool NESForkServer::Impl::dispatch(Command command, const int *actions) {
+
+	if (m_failed) {
+		return false;
+	}
+
+	for (int i = 0; i < (int) m_pids.size(); i++) {
+		m_slots[i].command = command;
+		m_slots[i].action = actions ? actions[i] : ACT_NOOP;
+		sem_post(&m_slots[i].start);
+	}
+
+	// Wait for one post per worker, checking now and then that none died.
+	for (int i = 0; i < (int) m_pids.size(); i++) {
+		for (;;) {
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += 1;
+			if (sem_timedwait(m_done, &deadline) == 0) {
+				break;
+			}
+			if (errno == ETIMEDOUT && !checkWorkers()) {
+				m_failed = true;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool NESForkServer::Impl::isReady() const {
+	return !m_failed;
+}
+
+int NESForkServer::Impl::getNumEnvs() const {
+	return m_pids.size();
+}
+
+int NESForkServer::Impl::getFrameSize() const {
+	return m_frame_size;
+}
+
+void NESForkServer::Impl::resetAll() {
+	dispatch(CMD_RESET, NULL);
+}
+
+bool NESForkServer::Impl::act(const int *actions) {
+	return dispatch(CMD_ACT, actions);
+}
+
+const int *NESForkServer::Impl::getRewards() const {
+	return m_rewards;
+}
+
+const bool *NESForkServer::Impl::getDones() const {
+	return m_dones;
+}
+
+const unsigned char *NESForkServer::Impl::getFrames() const {
+	return m_frames;
+}
+
+/* --------------------------------------------------------------------------------------------------*/
+
+/* begin PIMPL wrapper */
+
+bool NESForkServer::isReady() const {
+    return m_pimpl->isReady();
+}
+
+int NESForkServer::getNumEnvs() const {
+    return m_pimpl->getNumEnvs();
+}
+
+int NESForkServer::getFrameSize() const {
+    return m_pimpl->getFrameSize();
+}
+
+void NESForkServer::resetAll() {
+    m_pimpl->resetAll();
+}
+
+bool NESForkServer::act(const int *actions) {
+    return m_pimpl->act(actions);
+}
+
+const int *NESForkServer::getRewards() const {
+    return m_pimpl->getRewards();
+}
+
+const bool *NESForkServer::getDones() const {
+    return m_pimpl->getDones();
+}
+
+const unsigned char *NESForkServer::getFrames() const {
+    return m_pimpl->getFrames();
+}
+
+NESForkServer::NESForkServer(const std::string &rom_file, int num_envs,
+                             int obs_width, int obs_height, bool grayscale) :
+    m_pimpl(new NESForkServer::Impl(rom_file, num_envs, obs_width, obs_height, grayscale)) {
+
+}
+
+NESForkServer::~NESForkServer() {
+    delete m_pimpl;
+}
+
+} // namespace nes
@@ -0,0 +1,73 @@
+#ifndef __NES_FORK_SERVER_HPP__
+#define __NES_FORK_SERVER_HPP__
+
+#include "nes_interface.hpp"
+
+namespace nes {
+
+// This class steps a batch of environments, each in its own process. The
+// ROM is loaded and reset once, then the worker processes are forked from
+// that warm state, sharing its memory copy-on-write. Rewards, done flags
+// and frames are written into one shared memory slab that the caller reads
+// in place.
+class NESForkServer {
+
+    public:
+
+        /** create num_envs environments running rom_file. If obs_width is
+            not 0 the frames are observations in the given format (see
+            NESInterface::setObservationFormat), otherwise raw screens.
+            Worker i is seeded with i + 1 (see NESInterface::setSeed).
+            Create it before other threads start using NESInterface, as
+            only the calling thread survives the fork. Workers are killed
+            when that thread or its process exits. */
+        NESForkServer(const std::string &rom_file, int num_envs,
+                      int obs_width = 0, int obs_height = 0, bool grayscale = true);
+
+        /** Stop the worker processes and unmap the slab. */
+        ~NESForkServer();
+
+        /** Returns false if the shared memory could not be mapped, not
+            every worker could be started or a worker has died. No steps
+            are possible then and the result getters may return NULL. */
+        bool isReady() const;
+
+        /** Returns the number of environments. */
+        int getNumEnvs() const;
+
+        /** Returns the size in bytes of one environment's frame. */
+        int getFrameSize() const;
+
+        /** Resets every environment. */
+        void resetAll();
+
+        /** Applies actions[i] to environment i and waits for all of them.
+            Returns false if a worker process has died. As with
+            NESInterface::act it is the user's responsibility to reset
+            environments that are done. */
+        bool act(const int *actions);
+
+        /** The results of the last step, one entry per environment. They
+            live in the shared slab and are overwritten by the next step. */
+        const int *getRewards() const;
+        const bool *getDones() const;
+
+        /** The frames of the last step, getFrameSize() bytes per
+            environment one after the other. */
+        const unsigned char *getFrames() const;
+
+    private:
+
+        /** Copying is explicitly disallowed. */
+        NESForkServer(const NESForkServer &);
+
+        /** Assignment is explicitly disallowed. */
+        NESForkServer &operator=(const NESForkServer &);
+
+        class Impl;
+        Impl *m_pimpl;
+};
+
+} // namespace nes
+
+#endif // __NES_FORK_SERVER_HPP__
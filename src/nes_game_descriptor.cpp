@@ -0,0 +1,440 @@
+#include "nes_game_descriptor.hpp"
+#include "nes_interface.hpp"
+#include "types.h"
+#include "fceu.h"
+#include "cheat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+
+namespace nes {
+
+// The rules act() used to hard-code for Super Mario Bros. They apply to
+// any ROM without a descriptor of its own.
+static const char *DEFAULT_DESCRIPTOR =
+	"name Super Mario Bros.\n"
+	"crc32 0x3337ec46\n"
+	"field score 0x07dd 6 digits\n"
+	"field x 0x0086\n"
+	"field lives 0x075a\n"
+	"field state 0x0770\n"
+	"score score 10\n"
+	"reward score 10 positive\n"
+	"reward x 5 limit 100\n"
+	"lives lives\n"
+	"terminal state != 1\n"
+	"start noop 60\n"
+	"start select 10\n";
+
+// The actions every game has, by number. Numbers without a name are not
+// actions. ACT_SELECT has always held Start, which is what gets a game going.
+static const struct {
+	const char *name;
+	int buttons;
+	bool legal;
+} BUILTIN_ACTIONS[NUM_NES_BUILTIN_ACTIONS] = {
+	{ "noop", 0x00, true },     // ACT_NOOP
+	{ "a", 0x01, true },        // ACT_A
+	{ "b", 0x02, true },        // ACT_B
+	{ "up", 0x10, true },       // ACT_UP
+	{ "right", 0x80, true },    // ACT_RIGHT
+	{ "left", 0x40, true },     // ACT_LEFT
+	{ "down", 0x20, true },     // ACT_DOWN
+	{ "a_up", 0x11, true },     // ACT_A_UP
+	{ "a_right", 0x81, true },  // ACT_A_RIGHT
+	{ "a_left", 0x41, true },   // ACT_A_LEFT
+	{ "a_down", 0x21, true },   // ACT_A_DOWN
+	{ "b_up", 0x12, true },     // ACT_B_UP
+	{ "b_right", 0x82, true },  // ACT_B_RIGHT
+	{ "b_left", 0x42, true },   // ACT_B_LEFT
+	{ "b_down", 0x22, true },   // ACT_B_DOWN
+	{ NULL, -1, false },        // ACT_RESET
+	{ NULL, -1, false },        // ACT_UNDEFINED
+	{ NULL, -1, false },        // ACT_RANDOM
+	{ "select", 0x08, false }   // ACT_SELECT
+};
+
+// Gamepad buttons by name, in the order of their bits.
+static const char *BUTTON_NAMES[8] = {
+	"a", "b", "select", "start", "up", "down", "left", "right"
+};
+
+// Parses an integer in decimal or 0x-prefixed hex.
+static bool parseInt(const std::string &s, long *value) {
+	char *end;
+	*value = strtol(s.c_str(), &end, 0);
+	return !s.empty() && *end == '\0';
+}
+
+GameDescriptor::GameDescriptor() :
+    m_score_field(-1),
+    m_score_scale(1),
+    m_lives_field(-1)
+{
+	for (int i = 0; i < NUM_NES_BUILTIN_ACTIONS; i++) {
+		m_action_names.push_back(BUILTIN_ACTIONS[i].name ? BUILTIN_ACTIONS[i].name : "");
+		m_buttons.push_back(BUILTIN_ACTIONS[i].buttons);
+		if (BUILTIN_ACTIONS[i].legal) {
+			m_legal.push_back(i);
+		}
+	}
+}
+
+bool GameDescriptor::parse(const std::string &text, const std::string &source) {
+
+	GameDescriptor d;
+	std::istringstream lines(text);
+	std::string line;
+	int line_number = 0;
+
+	while (std::getline(lines, line)) {
+		line_number++;
+		size_t hash = line.find('#');
+		if (hash != std::string::npos) {
+			line.erase(hash);
+		}
+
+		std::istringstream words(line);
+		std::vector<std::string> w;
+		std::string word;
+		while (words >> word) {
+			w.push_back(word);
+		}
+		if (w.empty()) {
+			continue;
+		}
+
+		bool ok = false;
+		long a = 0, b = 0;
+		const std::string &key = w[0];
+
+		if (key == "name" && w.size() > 1) {
+			d.m_name = line.substr(line.find(w[1]));
+			d.m_name.erase(d.m_name.find_last_not_of(" \t\r") + 1);
+			ok = true;
+		}
+		else if (key == "crc32" && w.size() == 2) {
+			// Always hex, as printed when a ROM is loaded.
+			char *end;
+			d.m_crc32s.push_back(strtoul(w[1].c_str(), &end, 16));
+			ok = *end == '\0';
+		}
+		else if (key == "md5" && w.size() == 2) {
+			std::string md5 = w[1];
+			if (md5.compare(0, 2, "0x") == 0) {
+				md5.erase(0, 2);
+			}
+			ok = md5.size() == 32;
+			d.m_md5s.push_back(md5);
+		}
+		else if (key == "field" && w.size() >= 3 && w.size() <= 5 && d.findField(w[1]) < 0) {
+			Field f;
+			f.name = w[1];
+			f.bytes = 1;
+			f.encoding = ENC_BINARY;
+			ok = parseInt(w[2], &a) && a >= 0 && a <= 0xFFFF;
+			f.address = a;
+			if (ok && w.size() >= 4) {
+				ok = parseInt(w[3], &b) && b >= 1 && b <= 9;
+				f.bytes = b;
+			}
+			if (ok && w.size() == 5) {
+				if (w[4] == "binary") f.encoding = ENC_BINARY;
+				else if (w[4] == "bcd") f.encoding = ENC_BCD;
+				else if (w[4] == "digits") f.encoding = ENC_DIGITS;
+				else ok = false;
+			}
+			// Keep every decoded value within an int.
+			if (ok && f.encoding != ENC_DIGITS && f.bytes > 4) {
+				ok = false;
+			}
+			d.m_fields.push_back(f);
+		}
+		else if (key == "reward" && w.size() >= 2) {
+			RewardTerm r;
+			r.field = d.findField(w[1]);
+			r.scale = 1;
+			r.positive = false;
+			r.limit = 0;
+			ok = r.field >= 0;
+			size_t i = 2;
+			if (ok && i < w.size() && parseInt(w[i], &a)) {
+				r.scale = a;
+				i++;
+			}
+			for (; ok && i < w.size(); i++) {
+				if (w[i] == "positive") {
+					r.positive = true;
+				} else if (w[i] == "limit" && i + 1 < w.size() && parseInt(w[i + 1], &a) && a > 0) {
+					r.limit = a;
+					i++;
+				} else {
+					ok = false;
+				}
+			}
+			d.m_rewards.push_back(r);
+		}
+		else if (key == "score" && (w.size() == 2 || w.size() == 3)) {
+			d.m_score_field = d.findField(w[1]);
+			ok = d.m_score_field >= 0;
+			if (ok && w.size() == 3) {
+				ok = parseInt(w[2], &a);
+				d.m_score_scale = a;
+			}
+		}
+		else if (key == "lives" && w.size() == 2) {
+			d.m_lives_field = d.findField(w[1]);
+			ok = d.m_lives_field >= 0;
+		}
+		else if (key == "terminal" && w.size() == 4) {
+			Terminal t;
+			t.field = d.findField(w[1]);
+			ok = t.field >= 0 && parseInt(w[3], &a);
+			t.value = a;
+			if (w[2] == "==") t.op = OP_EQ;
+			else if (w[2] == "!=") t.op = OP_NE;
+			else if (w[2] == "<") t.op = OP_LT;
+			else if (w[2] == "<=") t.op = OP_LE;
+			else if (w[2] == ">") t.op = OP_GT;
+			else if (w[2] == ">=") t.op = OP_GE;
+			else ok = false;
+			d.m_terminals.push_back(t);
+		}
+		else if (key == "start" && w.size() == 3) {
+			StartStep s;
+			s.action = d.findAction(w[1]);
+			ok = s.action >= 0 && parseInt(w[2], &a) && a >= 0;
+			s.frames = a;
+			d.m_start.push_back(s);
+		}
+		else if (key == "action" && w.size() >= 2) {
+			int buttons = 0;
+			ok = true;
+			for (size_t i = 2; ok && i < w.size(); i++) {
+				int b = 0;
+				while (b < 8 && w[i] != BUTTON_NAMES[b]) {
+					b++;
+				}
+				ok = b < 8;
+				buttons |= 1 << b;
+			}
+			int action = d.findAction(w[1]);
+			if (action < 0) {
+				action = d.m_buttons.size();
+				d.m_action_names.push_back(w[1]);
+				d.m_buttons.push_back(0);
+				d.m_legal.push_back(action);
+			}
+			d.m_buttons[action] = buttons;
+		}
+		else if (key == "minimal" && w.size() >= 2) {
+			ok = true;
+			for (size_t i = 1; ok && i < w.size(); i++) {
+				int action = d.findAction(w[i]);
+				ok = action >= 0;
+				d.m_minimal.push_back(action);
+			}
+		}
+
+		if (!ok) {
+			printf("ERROR: %s:%d: cannot parse '%s'.\n", source.c_str(), line_number, line.c_str());
+			return false;
+		}
+	}
+
+	d.m_text = text;
+	d.m_baselines.assign(d.m_rewards.size(), 0);
+	*this = d;
+	return true;
+}
+
+bool GameDescriptor::loadFile(const std::string &path) {
+
+	std::ifstream in(path.c_str());
+	if (!in) {
+		printf("ERROR: Could not open game descriptor %s.\n", path.c_str());
+		return false;
+	}
+	std::stringstream text;
+	text << in.rdbuf();
+	return parse(text.str(), path);
+}
+
+void GameDescriptor::loadForGame(unsigned int crc32, const std::string &md5) {
+
+	const char *path = getenv("NES_GAMES_PATH");
+	std::istringstream dirs(path ? path : "");
+	std::string dir;
+
+	while (std::getline(dirs, dir, ':')) {
+		DIR *d = opendir(dir.c_str());
+		if (!d) {
+			continue;
+		}
+		struct dirent *entry;
+		while ((entry = readdir(d)) != NULL) {
+			size_t len = strlen(entry->d_name);
+			if (len < 5 || strcmp(entry->d_name + len - 5, ".game") != 0) {
+				continue;
+			}
+			GameDescriptor candidate;
+			if (candidate.loadFile(dir + "/" + entry->d_name) && candidate.matches(crc32, md5)) {
+				closedir(d);
+				*this = candidate;
+				return;
+			}
+		}
+		closedir(d);
+	}
+
+	parse(DEFAULT_DESCRIPTOR, "built-in descriptor");
+}
+
+bool GameDescriptor::matches(unsigned int crc32, const std::string &md5) const {
+
+	for (size_t i = 0; i < m_crc32s.size(); i++) {
+		if (m_crc32s[i] == crc32) {
+			return true;
+		}
+	}
+	for (size_t i = 0; i < m_md5s.size(); i++) {
+		if (strcasecmp(m_md5s[i].c_str(), md5.c_str()) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+const std::string &GameDescriptor::getName() const {
+	return m_name;
+}
+
+const std::string &GameDescriptor::getText() const {
+	return m_text;
+}
+
+const std::vector<GameDescriptor::StartStep> &GameDescriptor::getStartSequence() const {
+	return m_start;
+}
+
+const std::vector<int> &GameDescriptor::getLegalActions() const {
+	return m_legal;
+}
+
+const std::vector<int> &GameDescriptor::getMinimalActions() const {
+	return m_minimal.empty() ? m_legal : m_minimal;
+}
+
+int GameDescriptor::read(int field) const {
+
+	const Field &f = m_fields[field];
+	int value = 0;
+	for (int i = 0; i < f.bytes; i++) {
+		unsigned int address = f.address + i;
+
+		// Work RAM and its mirrors are read directly; anything else goes
+		// through the CPU read handlers.
+		uint8 byte = address < 0x2000 ? RAM[address & 0x7FF] : FCEU_CheatGetByte(address);
+
+		switch (f.encoding) {
+			case ENC_BINARY:
+				value |= byte << (8 * i);
+				break;
+			case ENC_BCD:
+				value = value * 100 + (byte >> 4) * 10 + (byte & 0xF);
+				break;
+			case ENC_DIGITS:
+				value = value * 10 + byte;
+				break;
+		}
+	}
+	return value;
+}
+
+int GameDescriptor::findField(const std::string &name) const {
+
+	for (size_t i = 0; i < m_fields.size(); i++) {
+		if (m_fields[i].name == name) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int GameDescriptor::findAction(const std::string &name) const {
+
+	for (size_t i = 0; i < m_action_names.size(); i++) {
+		if (!m_action_names[i].empty() && m_action_names[i] == name) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int GameDescriptor::getLives() const {
+	return m_lives_field >= 0 ? read(m_lives_field) : 0;
+}
+
+int GameDescriptor::getScore() const {
+	return m_score_field >= 0 ? read(m_score_field) * m_score_scale : 0;
+}
+
+bool GameDescriptor::isTerminal() const {
+
+	for (size_t i = 0; i < m_terminals.size(); i++) {
+		const Terminal &t = m_terminals[i];
+		int v = read(t.field);
+		bool hit = false;
+		switch (t.op) {
+			case OP_EQ: hit = v == t.value; break;
+			case OP_NE: hit = v != t.value; break;
+			case OP_LT: hit = v < t.value; break;
+			case OP_LE: hit = v <= t.value; break;
+			case OP_GT: hit = v > t.value; break;
+			case OP_GE: hit = v >= t.value; break;
+		}
+		if (hit) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int GameDescriptor::collectReward() {
+
+	int reward = 0;
+	for (size_t i = 0; i < m_rewards.size(); i++) {
+		const RewardTerm &r = m_rewards[i];
+		int value = read(r.field);
+		int delta = (value - m_baselines[i]) * r.scale;
+		m_baselines[i] = value;
+
+		// Level resets and the like make values jump; ignore those.
+		if (r.limit && abs(delta) > r.limit) {
+			continue;
+		}
+		if (r.positive && delta < 0) {
+			continue;
+		}
+		reward += delta;
+	}
+	return reward;
+}
+
+void GameDescriptor::resetBaselines() {
+	m_baselines.assign(m_rewards.size(), 0);
+}
+
+std::vector<int> &GameDescriptor::getBaselines() {
+	return m_baselines;
+}
+
+const std::vector<int> &GameDescriptor::getBaselines() const {
+	return m_baselines;
+}
+
+} // namespace nes
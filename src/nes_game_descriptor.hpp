@@ -0,0 +1,178 @@
+#ifndef __NES_GAME_DESCRIPTOR_HPP__
+#define __NES_GAME_DESCRIPTOR_HPP__
+
+#include <string>
+#include <vector>
+
+namespace nes {
+
+// Describes how to score a game from its RAM: which bytes hold what, how
+// they are encoded, what earns reward and when an episode is over. A
+// descriptor is a small text file, one directive per line, '#' starts a
+// comment:
+//
+//   name <text>                         Human readable name
+//   crc32 <hex>                         ROMs this applies to, as printed
+//   md5 <hex>                           when loading (either may repeat)
+//   field <name> <addr> [bytes] [enc]   A RAM value; enc is binary (little
+//                                       endian, default), bcd (packed, most
+//                                       significant byte first) or digits
+//                                       (one decimal digit per byte, most
+//                                       significant first)
+//   reward <field> [scale] [positive] [limit <n>]
+//                                       Adds scale times the change of the
+//                                       field each frame. positive drops
+//                                       decreases, limit drops changes
+//                                       larger than n (after scaling)
+//   score <field> [scale]               Value reported as the game score
+//   lives <field>                       Value reported as remaining lives
+//   terminal <field> <op> <value>       Episode is over while this holds;
+//                                       op is one of == != < <= > >=
+//   start <action> <frames>             Input played after a reset, e.g.
+//                                       to get past the title screen
+//   action <name> [button]...           Defines an action as the buttons
+//                                       it holds (a b select start up down
+//                                       left right), or redefines a
+//                                       built-in one. New actions are
+//                                       legal and numbered from
+//                                       NUM_NES_BUILTIN_ACTIONS on
+//   minimal <action>...                 Actions the game actually needs,
+//                                       in order (may repeat); all legal
+//                                       actions by default
+//
+// Actions have to be defined before start and minimal lines use them.
+class GameDescriptor {
+
+    public:
+
+        struct StartStep {
+            int action;
+            int frames;
+        };
+
+        GameDescriptor();
+
+        /** Parses descriptor text. Prints the offending line and returns
+            false on errors, leaving the descriptor unchanged. */
+        bool parse(const std::string &text, const std::string &source);
+
+        /** Parses a descriptor file. */
+        bool loadFile(const std::string &path);
+
+        /** Loads the first descriptor in the colon separated directories
+            of $NES_GAMES_PATH that lists the given ROM checksums, falling
+            back to the built-in Super Mario Bros. descriptor. */
+        void loadForGame(unsigned int crc32, const std::string &md5);
+
+        /** Returns true if the descriptor lists one of the checksums. */
+        bool matches(unsigned int crc32, const std::string &md5) const;
+
+        /** Returns the name of the game. */
+        const std::string &getName() const;
+
+        /** Returns the text the descriptor was parsed from. */
+        const std::string &getText() const;
+
+        /** Returns the sequence of inputs played after a reset. */
+        const std::vector<StartStep> &getStartSequence() const;
+
+        /** Returns the gamepad buttons an action holds, one bit per
+            button in the emulator's order, or -1 if it is undefined. */
+        int getButtons(int action) const {
+            return action >= 0 && action < (int) m_buttons.size() ? m_buttons[action] : -1;
+        }
+
+        /** Returns every action an agent may take. */
+        const std::vector<int> &getLegalActions() const;
+
+        /** Returns the actions the game needs. */
+        const std::vector<int> &getMinimalActions() const;
+
+        /** Returns the remaining lives, or 0 if the game has none. */
+        int getLives() const;
+
+        /** Returns the game score, or 0 if the game has none. */
+        int getScore() const;
+
+        /** Returns true if a terminal condition holds. */
+        bool isTerminal() const;
+
+        /** Returns the reward earned since the last call. */
+        int collectReward();
+
+        /** Forgets the reward fields' previous values, as at the start of
+            an episode. */
+        void resetBaselines();
+
+        /** Previous values of the reward fields, saved with snapshots. */
+        std::vector<int> &getBaselines();
+        const std::vector<int> &getBaselines() const;
+
+    private:
+
+        enum Encoding {
+            ENC_BINARY,
+            ENC_BCD,
+            ENC_DIGITS
+        };
+
+        enum Op {
+            OP_EQ,
+            OP_NE,
+            OP_LT,
+            OP_LE,
+            OP_GT,
+            OP_GE
+        };
+
+        struct Field {
+            std::string name;
+            unsigned int address;
+            int bytes;
+            Encoding encoding;
+        };
+
+        struct RewardTerm {
+            int field;
+            int scale;
+            bool positive;
+            int limit; // 0 means no limit
+        };
+
+        struct Terminal {
+            int field;
+            Op op;
+            int value;
+        };
+
+        // Reads and decodes a field from the running game.
+        int read(int field) const;
+
+        // Returns the index of a named field, or -1.
+        int findField(const std::string &name) const;
+
+        // Returns the number of a named action, or -1.
+        int findAction(const std::string &name) const;
+
+        std::string m_text;
+        std::string m_name;
+        std::vector<unsigned int> m_crc32s;
+        std::vector<std::string> m_md5s;
+        std::vector<Field> m_fields;
+        std::vector<RewardTerm> m_rewards;
+        std::vector<Terminal> m_terminals;
+        std::vector<StartStep> m_start;
+        std::vector<std::string> m_action_names; // Name of each action number, empty if unused
+        std::vector<int> m_buttons;              // Buttons of each action number
+        std::vector<int> m_legal;
+        std::vector<int> m_minimal;              // Empty if the legal actions are minimal
+        int m_score_field;
+        int m_score_scale;
+        int m_lives_field;
+
+        std::vector<int> m_baselines; // Previous value of each reward term
+};
+
+} // namespace nes
+
+#endif // __NES_GAME_DESCRIPTOR_HPP__
@@ -1,20 +1,53 @@
 #include "nes_interface.hpp"
+#include "nes_observation.hpp"
+#include "nes_palette.hpp"
+#include "nes_game_descriptor.hpp"
+#include "nes_delta_snapshot.hpp"
+#ifdef HEADLESS
+#include "drivers/headless/headless.h"
+#else
 #include "drivers/sdl/config.h"
 #include "drivers/sdl/sdl.h"
+#endif
 #include "driver.h"
 #include "fceu.h"
 #include "cheat.h"
 #include "video.h"
+#include "ppu.h"
+#include "state.h"
+#include "emufile.h"
+#include "utils/endian.h"
+#include "utils/md5.h"
+#include "zlib.h"
 #include <stdio.h>
+#include <pthread.h>
+#include <algorithm>
+
+#ifndef HEADLESS
 #include <SDL/SDL.h>
 
 // Global configuration info.
 extern Config *g_config;
+#endif
 extern int noGui;
 extern uint8_t *XBuf;
+extern uint8_t *XBackBuf;
+extern uint32 iNESGameCRC32;
+extern uint8 SPRAM[0x100];
 
 namespace nes {
 
+// The emulator core keeps the whole machine in globals, so only one
+// NESInterface can drive it at a time. This lock serializes access to it:
+// instances in different threads take turns rather than run at once.
+static pthread_mutex_t core_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+class CoreMutexLock {
+    public:
+        CoreMutexLock() { pthread_mutex_lock(&core_mutex); }
+        ~CoreMutexLock() { pthread_mutex_unlock(&core_mutex); }
+};
+
 // Return the RGB value of a given pixel we got from XBuf.
 void NESInterface::getRGB(
     unsigned char pixel,
@@ -28,13 +61,35 @@ class NESInterface::Impl {
 
     public:
 
-        // create an NESInterface. This routine is not threadsafe!
+        // create an NESInterface. The first instance loads the ROM, later
+        // instances start from the same power-on state.
         Impl(const std::string &rom_file);
         ~Impl();
 
         // Resets the game
         void reset_game();
 
+        // Resets the game into the episode with the given seed.
+        void reset_game(unsigned int episode_seed);
+
+        // Seeds the generator episode seeds are drawn from.
+        void setSeed(unsigned int seed);
+
+        // Returns the seed of the current episode.
+        unsigned int getEpisodeSeed() const;
+
+        // Power-cycles with seeded RAM on every reset if set.
+        void setRandomizeRAM(bool randomize);
+
+        // Plays up to max_noops random no-op frames after every reset.
+        void setNoopStarts(int max_noops);
+
+        // Sets the chance that a frame keeps the previous action.
+        void setRepeatActionProbability(float probability);
+
+        // Draws frames only when the screen is read if set.
+        void setLazyRendering(bool lazy);
+
         // Indicates if the game has ended
         bool game_over();
 
@@ -43,12 +98,29 @@ class NESInterface::Impl {
         // buttons on the game over screen.
         int act(int action);
 
+        // Applies an action for repeat frames and returns the summed reward.
+        // Only the last frame is rendered.
+        int act(int action, int repeat, bool skip_sound);
+
+        // Applies one action per gamepad for repeat frames.
+        int actPlayers(int action1, int action2, int repeat, bool skip_sound);
+
+        // Applies an action, or resets on ACT_RESET, then reports the end of
+        // the game and copies the screen if screen is not NULL.
+        int step(int action, bool *done, unsigned char *screen, int screen_size);
+
         // Returns the number of legal actions.
         int getNumLegalActions();
 
         // Returns the vector of legal actions.
         void getLegalActionSet(int legal_actions[]);
 
+        // Returns the number of actions in the minimal action set.
+        int getNumMinimalActions();
+
+        // Returns the actions the game needs.
+        void getMinimalActionSet(int minimal_actions[]);
+
         // Minimum possible instantaneous reward.
         int minReward() const;
 
@@ -76,6 +148,19 @@ class NESInterface::Impl {
         // Return screen width.
         const int getScreenWidth() const;
 
+        // Returns the live frame buffer.
+        const unsigned char *getScreenBuffer() const;
+
+        // Copies the console RAM.
+        void getRAM(unsigned char *ram) const;
+
+        // Returns the live console RAM.
+        const unsigned char *getRAMBuffer() const;
+
+        // Decodes OAM and the sprites the PPU found on each line.
+        void getSpriteObservation(int *oam, unsigned char *line_sprites,
+                                  unsigned char *line_counts, int *scroll) const;
+
         // Returns the current score.
         const int getCurrentScore() const;
 
@@ -91,102 +176,701 @@ class NESInterface::Impl {
         // restores state from a string
         void restoreSnapshot(const std::string snapshot);
 
+        // Returns the size in bytes of a serialized snapshot.
+        int getSnapshotSize() const;
+
+        // Serializes the current state into a caller-provided buffer.
+        int cloneState(unsigned char *buf, int buf_size) const;
+
+        // Restores a state previously written by cloneState.
+        bool restoreState(const unsigned char *buf, int size);
+
+        // Snapshots the current state as a difference to parent, keeping
+        // a copy of the screen if asked.
+        DeltaSnapshot *cloneDeltaState(DeltaSnapshot *parent, bool screen) const;
+
+        // Restores a snapshot taken by cloneDeltaState.
+        bool restoreDeltaState(const DeltaSnapshot *snapshot);
+
         // Get the RGB data from the raw screen.
         void fillRGBfromPalette(unsigned char *raw_screen, unsigned char *rgb_screen, int raw_screen_size);
 
+        // Writes the current screen in colour.
+        void getScreenRGB(unsigned char *out, int out_size, int format);
+
+        // Sets the size, colour mode and crop of getObservation.
+        bool setObservationFormat(int width, int height, bool grayscale,
+                                  int crop_top, int crop_bottom, int crop_left, int crop_right);
+
+        // Returns the size in bytes of an observation.
+        int getObservationSize() const;
+
+        // Writes the preprocessed current screen into obs.
+        void getObservation(unsigned char *obs, int obs_size);
+
+        // Replaces the game descriptor with one read from a file.
+        bool loadGameDescriptor(const std::string &path);
+
+        // Fills the start pool with states reached by random no-op runs.
+        void generateStartPool(int num_states, int max_noops, unsigned int seed);
+
+        // Adds the current state to the start pool.
+        void addStartState();
+
+        // Empties the start pool.
+        void clearStartPool();
+
+        // Returns the number of states in the start pool.
+        int getStartPoolSize() const;
+
+        // Writes the start pool to a file.
+        bool saveStartPool(const std::string &path) const;
+
+        // Replaces the start pool with one read from a file.
+        bool loadStartPool(const std::string &path);
+
+        // Returns false if the instance could not join the core.
+        bool isValid() const;
+
+        // Swaps this instance's context into the emulator core if another
+        // instance currently owns it. Must be called with core_mutex held.
+        // Returns false, leaving no instance current, if the instance is
+        // invalid or its context could not be loaded.
+        bool makeCurrent();
+
     private:
 
+        // Picks the game descriptor for the loaded ROM and sets the
+        // default observation format.
+        void initGame();
+
+        // Describes everything the state after a reset depends on.
+        std::string startStateKey() const;
+
+        // Sets the input word of a gamepad for an action.
+        void setAction(int port, int action);
+
+        // Steps repeat frames with actions[p] on the first num_players
+        // gamepads and nothing on the others.
+        int actPorts(const int *actions, int num_players, int repeat, bool skip_sound);
+
+        // Restores the cached start state, or plays the start sequence
+        // after a soft reset and caches where it ends up.
+        void restoreStartState();
+
+        // Clears the episode counters and plays the game descriptor's
+        // start sequence.
+        void playStartSequence();
+
+        // Emulates one frame with the given FCEUI_Emulate skip mode and
+        // returns the reward collected during it.
+        int stepFrame(int skip);
+
+        static Impl *s_current;              // Instance whose context is loaded in the core
+        static int s_num_instances;          // Live instances sharing the core
+        static std::string s_rom_file;       // ROM loaded in the core
+        static std::vector<u8> s_boot_state; // Power-on state handed to new instances
+        static std::vector<u8> s_start_state; // State reached by the first reset
+        static std::string s_start_key;       // startStateKey() of s_start_state
+        static std::vector<std::vector<u8> > s_start_pool; // States resets pick from at random
+        static std::string s_pool_key;        // startStateKey() of s_start_pool
+
+        // Serializes the emulator and interface state into m_snapshot,
+        // with the screen unless told otherwise.
+        void serializeState(bool screen = true) const;
+
+        // Restores the emulator and interface state from a snapshot stream.
+        // Unless episode is set, the randomness and last actions of the
+        // current episode are kept rather than taken from the snapshot.
+        bool deserializeState(EMUFILE *is, bool episode = true);
+
+        mutable EMUFILE_MEMORY m_snapshot; // Reusable buffer for in-memory snapshots
+        std::vector<u8> m_restore_buf;     // Reusable buffer for restoring raw snapshots
+        std::vector<u8> m_saved_state;     // State slot used by saveState/loadState
+        std::vector<u8> m_context;         // Machine state while another instance owns the core
+        PaletteLUT m_palette;               // Copy of the palette for colour conversion
+        ObservationProcessor m_observation; // Turns screens into observations for getObservation
+        GameDescriptor m_game;              // Where the game keeps its score, lives and state
         int m_episode_score; // Score accumulated throughout the course of an episode
         bool m_display_active;    // Should the screen be displayed or not
         int m_max_num_frames;     // Maximum number of frames for each episode
-        int nes_input; // Input to the emulator.
+        uint32 nes_input[NES_NUM_PLAYERS]; // Input to the emulator, one word per gamepad
+        unsigned int m_rng;              // Draws the seed of each episode
+        unsigned int m_episode_seed;     // Seed of the current episode
+        unsigned int m_episode_rng;      // Randomness within the episode
+        bool m_randomize_ram;            // Power-cycle with seeded RAM on reset
+        int m_max_noops;                 // Most no-op frames played after reset
+        unsigned int m_sticky_threshold; // Repeat the last action if a draw is below this
+        int m_last_action[NES_NUM_PLAYERS]; // Action applied on the previous frame
+        bool m_lazy_rendering;           // Draw frames only when the screen is read
+        bool m_valid;                    // Joined the core; false for a mismatched ROM
         int current_game_score;
-        int current_x;
         int remaining_lives;
         int game_state;
         int episode_frame_number;
 };
 
 
+NESInterface::Impl *NESInterface::Impl::s_current = NULL;
+int NESInterface::Impl::s_num_instances = 0;
+std::string NESInterface::Impl::s_rom_file;
+std::vector<u8> NESInterface::Impl::s_boot_state;
+std::vector<u8> NESInterface::Impl::s_start_state;
+std::string NESInterface::Impl::s_start_key;
+std::vector<std::vector<u8> > NESInterface::Impl::s_start_pool;
+std::string NESInterface::Impl::s_pool_key;
+
+// Magic at the start of start pool files.
+static const char START_POOL_MAGIC[8] = { 'N', 'E', 'S', 'P', 'O', 'O', 'L', '2' };
+
+// Small xorshift generator for picking start states.
+static unsigned int nextRandom(unsigned int *state) {
+	unsigned int x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+// Holds the core lock and makes the given instance current for the
+// duration of a public call. Calls must leave the core alone if it tests
+// false.
+class NESInterface::ContextGuard {
+    public:
+        ContextGuard(NESInterface::Impl *impl) : m_current(impl->makeCurrent()) {}
+        operator bool() const { return m_current; }
+    private:
+        CoreMutexLock m_lock;
+        bool m_current;
+};
+
 NESInterface::Impl::~Impl() {
 
+	CoreMutexLock lock;
+	if (!m_valid) {
+		return;
+	}
+	if (s_current == this) {
+		s_current = NULL;
+	}
+
+	// The last instance out shuts the emulator down.
+	if (--s_num_instances > 0) {
+		return;
+	}
+	s_rom_file.clear();
+	s_boot_state.clear();
+	s_start_state.clear();
+	s_start_key.clear();
+	s_start_pool.clear();
+	s_pool_key.clear();
 	CloseGame();
 	FCEUI_Kill();
+#ifndef HEADLESS
 	SDL_Quit();
+#endif
+}
+
+bool NESInterface::Impl::isValid() const {
+	return m_valid;
+}
+
+bool NESInterface::Impl::makeCurrent() {
+
+	if (s_current == this) {
+		return true;
+	}
+	if (!m_valid) {
+		return false;
+	}
+
+	// Park the previous owner's machine state in its own context.
+	if (s_current) {
+		s_current->serializeState();
+		s_current->m_context.assign(s_current->m_snapshot.buf(),
+				s_current->m_snapshot.buf() + s_current->m_snapshot.size());
+	}
+
+	// Whatever the core holds now is parked, so it can be left to the
+	// next instance that swaps in.
+	s_current = NULL;
+	EMUFILE_MEMORY is(&m_context);
+	if (!deserializeState(&is)) {
+		printf("ERROR: Could not switch the emulator core to this NESInterface.\n");
+		return false;
+	}
+
+	// Each instance feeds the gamepads from its own input words.
+	FCEUI_SetInput(0, (ESI) SI_GAMEPAD, &nes_input[0], 0);
+	FCEUI_SetInput(1, (ESI) SI_GAMEPAD, &nes_input[1], 0);
+	FCEUPPU_SetLazyRendering(m_lazy_rendering);
+	s_current = this;
+	return true;
 }
 
 bool NESInterface::Impl::loadState() {
 
-	// TODO implement
-	printf("loadState is not implemented...");
-	//FCEUI_LoadState();
-	return false;
+	if (m_saved_state.empty()) {
+		return false;
+	}
+	return restoreState(&m_saved_state[0], m_saved_state.size());
 }
 
 bool NESInterface::Impl::game_over() {
 
 	// Update game state.
-	game_state = FCEU_CheatGetByte(0x0770);
+	game_state = m_game.isTerminal();
+	if (!game_state) return false;
 
-	// Return true only if this byte is 1.
-	if (game_state == 1) return false;
-
-	// Reset the score and position.
+	// Reset the score and the reward baselines.
 	current_game_score = 0;
-	current_x = 0;
+	m_game.resetBaselines();
 	return true;
 }
 
+std::string NESInterface::Impl::startStateKey() const {
+
+	char key[64];
+	snprintf(key, sizeof(key), "%08x %s %d %d\n", iNESGameCRC32,
+			md5_asciistr(GameInfo->MD5), PAL, dendy);
+	return key + m_game.getText();
+}
+
 void NESInterface::Impl::reset_game() {
+	reset_game(nextRandom(&m_rng));
+}
+
+void NESInterface::Impl::reset_game(unsigned int episode_seed) {
+
+	m_episode_seed = episode_seed;
+	m_episode_rng = episode_seed ? episode_seed : 1;
+	m_last_action[0] = m_last_action[1] = ACT_NOOP;
+
+	if (m_randomize_ram) {
+		// The power-on RAM differs every episode, so there is nothing to
+		// cache; play the whole start sequence.
+		FCEU_MemoryRandSeed = nextRandom(&m_episode_rng);
+		PowerNES();
+		FCEU_MemoryRandSeed = 0;
+		playStartSequence();
+	} else {
+		restoreStartState();
+	}
+
+	if (m_max_noops > 0) {
+		int noops = nextRandom(&m_episode_rng) % (m_max_noops + 1);
+		for (int i = 0; i < noops; i++) {
+			act(ACT_NOOP);
+		}
+	}
+}
+
+void NESInterface::Impl::restoreStartState() {
+
+	std::string key = startStateKey();
+
+	// Start from a random state of the pool if there is one.
+	if (!s_start_pool.empty() && key == s_pool_key) {
+		EMUFILE_MEMORY is(&s_start_pool[nextRandom(&m_episode_rng) % s_start_pool.size()]);
+		if (deserializeState(&is, false)) {
+			return;
+		}
+	}
+
+	// After the first reset, jump straight to where it ended up instead of
+	// replaying the start sequence.
+	if (key == s_start_key) {
+		EMUFILE_MEMORY is(&s_start_state);
+		if (deserializeState(&is, false)) {
+			return;
+		}
+	}
 
 	// Pretty simple...
 	ResetNES();
+	playStartSequence();
 
-	// Initialize the score,position, and frame counter.
+	serializeState();
+	s_start_state.assign(m_snapshot.buf(), m_snapshot.buf() + m_snapshot.size());
+	s_start_key = key;
+}
+
+void NESInterface::Impl::playStartSequence() {
+
+	// Initialize the score, reward baselines and frame counter.
 	current_game_score = 0;
-	current_x = 0;
+	m_game.resetBaselines();
 	episode_frame_number = 0;
 
-	// Run a few frames first to get to the startup screen.
-	for (int i = 0; i<60; i++) {
-		NESInterface::Impl::act(ACT_NOOP);
+	// Get past the title screen as the game descriptor says, without
+	// sticky actions.
+	unsigned int sticky_threshold = m_sticky_threshold;
+	m_sticky_threshold = 0;
+	const std::vector<GameDescriptor::StartStep> &start = m_game.getStartSequence();
+	for (size_t s = 0; s < start.size(); s++) {
+		for (int i = 0; i < start[s].frames; i++) {
+			NESInterface::Impl::act(start[s].action);
+		}
 	}
+	m_sticky_threshold = sticky_threshold;
+	m_last_action[0] = m_last_action[1] = ACT_NOOP;
+}
+
+void NESInterface::Impl::setSeed(unsigned int seed) {
+	m_rng = seed ? seed : 1;
+}
 
-	// Hit the start button...
-	for (int i = 0; i<10; i++) {
-		NESInterface::Impl::act(ACT_SELECT);
+unsigned int NESInterface::Impl::getEpisodeSeed() const {
+	return m_episode_seed;
+}
+
+void NESInterface::Impl::setRandomizeRAM(bool randomize) {
+	m_randomize_ram = randomize;
+}
+
+void NESInterface::Impl::setNoopStarts(int max_noops) {
+	m_max_noops = max_noops > 0 ? max_noops : 0;
+}
+
+void NESInterface::Impl::setRepeatActionProbability(float probability) {
+	if (probability <= 0) {
+		m_sticky_threshold = 0;
+	} else if (probability >= 1) {
+		m_sticky_threshold = 0xFFFFFFFFu;
+	} else {
+		m_sticky_threshold = (unsigned int) (probability * 4294967296.0);
+	}
+}
+
+void NESInterface::Impl::setLazyRendering(bool lazy) {
+	m_lazy_rendering = lazy;
+	FCEUPPU_SetLazyRendering(lazy);
+}
+
+void NESInterface::Impl::generateStartPool(int num_states, int max_noops, unsigned int seed) {
+
+	if (num_states < 0 || max_noops < 0) {
+		printf("ERROR: Start pool needs a non-negative size and no-op count (got %d, %d).\n",
+				num_states, max_noops);
+		return;
+	}
+
+	// Work from the plain start state and put the caller's state back
+	// afterwards. Resetting would draw from m_rng and shift the episodes
+	// that follow.
+	serializeState();
+	std::vector<u8> saved(m_snapshot.buf(), m_snapshot.buf() + m_snapshot.size());
+	clearStartPool();
+
+	std::string key = startStateKey();
+	if (key != s_start_key) {
+		ResetNES();
+		playStartSequence();
+		serializeState();
+		s_start_state.assign(m_snapshot.buf(), m_snapshot.buf() + m_snapshot.size());
+		s_start_key = key;
+	}
+
+	unsigned int rng = seed ? seed : 1;
+	for (int i = 0; i < num_states; i++) {
+		EMUFILE_MEMORY is(&s_start_state);
+		if (!deserializeState(&is, false)) {
+			clearStartPool();
+			break;
+		}
+		int noops = nextRandom(&rng) % (max_noops + 1);
+		for (int j = 0; j < noops; j++) {
+			act(ACT_NOOP);
+		}
+		addStartState();
+	}
+
+	EMUFILE_MEMORY is(&saved);
+	if (!deserializeState(&is)) {
+		printf("ERROR: Could not restore the state from before the start pool was made.\n");
+	}
+}
+
+void NESInterface::Impl::addStartState() {
+
+	// States recorded under other rules cannot be mixed in.
+	std::string key = startStateKey();
+	if (key != s_pool_key) {
+		s_start_pool.clear();
+		s_pool_key = key;
+	}
+	serializeState();
+	s_start_pool.push_back(std::vector<u8>(m_snapshot.buf(), m_snapshot.buf() + m_snapshot.size()));
+}
+
+void NESInterface::Impl::clearStartPool() {
+	s_start_pool.clear();
+	s_pool_key.clear();
+}
+
+int NESInterface::Impl::getStartPoolSize() const {
+	return s_start_pool.size();
+}
+
+bool NESInterface::Impl::saveStartPool(const std::string &path) const {
+
+	FILE *fp = fopen(path.c_str(), "wb");
+	if (!fp) {
+		printf("ERROR: Could not open %s for writing.\n", path.c_str());
+		return false;
+	}
+
+	// Magic, the key the states were recorded under, then every state
+	// zlib compressed with its raw and compressed sizes.
+	fwrite(START_POOL_MAGIC, 1, sizeof(START_POOL_MAGIC), fp);
+	write32le(s_pool_key.size(), fp);
+	fwrite(s_pool_key.data(), 1, s_pool_key.size(), fp);
+	write32le(s_start_pool.size(), fp);
+
+	std::vector<u8> packed;
+	for (size_t i = 0; i < s_start_pool.size(); i++) {
+		const std::vector<u8> &state = s_start_pool[i];
+		uLongf packed_size = compressBound(state.size());
+		packed.resize(packed_size);
+		compress2(&packed[0], &packed_size, &state[0], state.size(), Z_BEST_COMPRESSION);
+		write32le(state.size(), fp);
+		write32le(packed_size, fp);
+		fwrite(&packed[0], 1, packed_size, fp);
+	}
+
+	bool ok = !ferror(fp);
+	if (fclose(fp) != 0 || !ok) {
+		printf("ERROR: Could not write start pool %s.\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool NESInterface::Impl::loadStartPool(const std::string &path) {
+
+	FILE *fp = fopen(path.c_str(), "rb");
+	if (!fp) {
+		printf("ERROR: Could not open start pool %s.\n", path.c_str());
+		return false;
+	}
+
+	char magic[sizeof(START_POOL_MAGIC)];
+	uint32 key_size = 0, count = 0;
+	std::string key;
+	std::vector<std::vector<u8> > pool;
+	bool ok = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+			memcmp(magic, START_POOL_MAGIC, sizeof(magic)) == 0 &&
+			read32le(&key_size, fp) && key_size < (1 << 20);
+	if (ok) {
+		key.resize(key_size);
+		ok = fread(&key[0], 1, key_size, fp) == key_size && read32le(&count, fp);
+	}
+	std::vector<u8> packed;
+	for (uint32 i = 0; ok && i < count; i++) {
+		uint32 size = 0, packed_size = 0;
+		ok = read32le(&size, fp) && read32le(&packed_size, fp) &&
+				size < (1 << 24) && packed_size < (1 << 24);
+		if (!ok) {
+			break;
+		}
+		packed.resize(packed_size);
+		pool.push_back(std::vector<u8>(size));
+		uLongf unpacked_size = size;
+		ok = fread(&packed[0], 1, packed_size, fp) == packed_size &&
+				uncompress(&pool.back()[0], &unpacked_size, &packed[0], packed_size) == Z_OK &&
+				unpacked_size == size;
+	}
+	fclose(fp);
+
+	if (!ok) {
+		printf("ERROR: %s is not a valid start pool.\n", path.c_str());
+		return false;
+	}
+	if (key != startStateKey()) {
+		printf("ERROR: Start pool %s was made for another ROM, region or game descriptor.\n", path.c_str());
+		return false;
+	}
+	s_start_pool.swap(pool);
+	s_pool_key = key;
+	return true;
+}
+
+void NESInterface::Impl::serializeState(bool screen) const {
+
+	// Savestates are written uncompressed into a buffer we keep around,
+	// so cloning never allocates once the buffer has grown to size.
+	// States carry the screen, so it has to be drawn first.
+	if (screen) {
+		FCEUPPU_DrawLazyFrame();
+	}
+
+	m_snapshot.set_len(0);
+	m_snapshot.unfail();
+
+	// The interface keeps its own bookkeeping for the reward computation.
+	// It goes ahead of the emulator state, with the number of baselines
+	// the game descriptor tracks, so a state taken under another
+	// descriptor is turned away before the core is touched.
+	write32le(current_game_score, &m_snapshot);
+	write32le(remaining_lives, &m_snapshot);
+	write32le(game_state, &m_snapshot);
+	write32le(episode_frame_number, &m_snapshot);
+	const std::vector<int> &baselines = m_game.getBaselines();
+	write32le((u32) baselines.size(), &m_snapshot);
+	for (size_t i = 0; i < baselines.size(); i++) {
+		write32le(baselines[i], &m_snapshot);
+	}
+
+	// Sticky actions draw from the episode's randomness and repeat the
+	// last actions, so a restored state must carry on with the same ones.
+	write32le(m_episode_rng, &m_snapshot);
+	for (int p = 0; p < NES_NUM_PLAYERS; p++) {
+		write32le(m_last_action[p], &m_snapshot);
 	}
+
+	FCEUSS_SaveMS(&m_snapshot, Z_NO_COMPRESSION, screen);
+}
+
+bool NESInterface::Impl::deserializeState(EMUFILE *is, bool episode) {
+
+	int score, lives, state, frame_number;
+	u32 num_baselines = 0;
+	read32le(&score, is);
+	read32le(&lives, is);
+	read32le(&state, is);
+	read32le(&frame_number, is);
+	std::vector<int> &baselines = m_game.getBaselines();
+	if (!read32le(&num_baselines, is) || num_baselines != baselines.size()) {
+		printf("ERROR: Snapshot was taken under a game descriptor with %u reward baselines, not %u.\n",
+				num_baselines, (unsigned) baselines.size());
+		return false;
+	}
+	std::vector<int> snapshot_baselines(num_baselines);
+	for (size_t i = 0; i < snapshot_baselines.size(); i++) {
+		read32le(&snapshot_baselines[i], is);
+	}
+
+	u32 episode_rng;
+	int last_action[NES_NUM_PLAYERS];
+	read32le(&episode_rng, is);
+	for (int p = 0; p < NES_NUM_PLAYERS; p++) {
+		read32le(&last_action[p], is);
+	}
+
+	if (is->fail() || !FCEUSS_LoadFP(is, SSLOADPARAM_NOBACKUP)) {
+		printf("ERROR: Could not restore snapshot.\n");
+		return false;
+	}
+
+	current_game_score = score;
+	remaining_lives = lives;
+	game_state = state;
+	episode_frame_number = frame_number;
+	baselines.swap(snapshot_baselines);
+	if (episode) {
+		m_episode_rng = episode_rng;
+		for (int p = 0; p < NES_NUM_PLAYERS; p++) {
+			m_last_action[p] = last_action[p];
+		}
+	}
+
+	// Savestates only carry the back buffer, so bring the screen in line
+	// with the restored machine.
+	memcpy(XBuf, XBackBuf, 256 * 256);
+	// The sprites found per line are not saved; drop the old frame's.
+	FCEUPPU_ClearLineSprites();
+	FCEUPPU_FrameScrollX = FCEUPPU_FrameScrollY = 0;
+	return true;
 }
 
 void NESInterface::Impl::saveState() {
 
-	// TODO implement
-	printf("saveState NOT IMPLEMENTED.\n");
-	//		FCEUD_SaveStateAs ();
+	serializeState();
+	m_saved_state.assign(m_snapshot.buf(), m_snapshot.buf() + m_snapshot.size());
 }
 
 std::string NESInterface::Impl::getSnapshot() const {
 
-	// TODO implement
-	printf("getSnapshot NOT IMPLEMENTED.\n");
-	/*
-    const ALEState* state = m_emu->environment->cloneState();
-    std::string snapshot = state->getStateAsString();
-    m_emu->environment->destroyState(state);
-    return snapshot;
-    */
-	return "";
+	serializeState();
+	return std::string((const char *) m_snapshot.buf(), m_snapshot.size());
 }
 
 void NESInterface::Impl::restoreSnapshot(const std::string snapshot) {
 
-	// TODO implement
-	printf("restoreSnapshot NOT IMPLEMENTED.\n");
-    //ALEState state(snapshot);
-    //m_emu->environment->restoreState(state);
+	if (snapshot.empty()) {
+		printf("ERROR: Empty snapshot passed to restoreSnapshot.\n");
+		return;
+	}
+	restoreState((const unsigned char *) snapshot.data(), snapshot.size());
+}
+
+int NESInterface::Impl::getSnapshotSize() const {
+
+	serializeState();
+	return m_snapshot.size();
+}
+
+int NESInterface::Impl::cloneState(unsigned char *buf, int buf_size) const {
+
+	serializeState();
+	int size = m_snapshot.size();
+	if (size > buf_size) {
+		printf("ERROR: Snapshot buffer too small (%d < %d).\n", buf_size, size);
+		return 0;
+	}
+	memcpy(buf, m_snapshot.buf(), size);
+	return size;
+}
+
+bool NESInterface::Impl::restoreState(const unsigned char *buf, int size) {
+
+	if (size <= 0) {
+		return false;
+	}
+
+	// Reuse the same vector for every restore to avoid reallocating.
+	m_restore_buf.assign(buf, buf + size);
+	EMUFILE_MEMORY is(&m_restore_buf);
+	return deserializeState(&is);
+}
+
+DeltaSnapshot *NESInterface::Impl::cloneDeltaState(DeltaSnapshot *parent, bool screen) const {
+
+	// The screen would turn every child of a scrolling game into a
+	// keyframe, so it stays out of the diff and is copied whole if asked.
+	if (!screen) {
+		serializeState(false);
+		return DeltaSnapshot::create(m_snapshot.buf(), m_snapshot.size(), parent);
+	}
+	FCEUPPU_DrawLazyFrame();
+	serializeState(false);
+	return DeltaSnapshot::create(m_snapshot.buf(), m_snapshot.size(), parent, XBackBuf, 256 * 256);
+}
+
+bool NESInterface::Impl::restoreDeltaState(const DeltaSnapshot *snapshot) {
+
+	if (!snapshot) {
+		return false;
+	}
+	snapshot->materialize(m_restore_buf);
+	EMUFILE_MEMORY is(&m_restore_buf);
+	if (!deserializeState(&is)) {
+		return false;
+	}
+
+	// Without a stored screen, show a blank one until the next frame.
+	const std::vector<u8> &screen = snapshot->getScreen();
+	if (screen.empty()) {
+		memset(XBackBuf, 0, 256 * 256);
+	} else {
+		memcpy(XBackBuf, &screen[0], 256 * 256);
+	}
+	memcpy(XBuf, XBackBuf, 256 * 256);
+	return true;
 }
 
 void NESInterface::Impl::getScreen(unsigned char *screen, int screen_size) {
+        FCEUPPU_DrawLazyFrame();
         memcpy(screen, XBuf, screen_size);
 }
 
@@ -198,18 +882,96 @@ const int NESInterface::Impl::getScreenWidth() const {
 	return NES_SCREEN_WIDTH;
 }
 
+const unsigned char *NESInterface::Impl::getScreenBuffer() const {
+	FCEUPPU_DrawLazyFrame();
+	return XBuf;
+}
+
+void NESInterface::Impl::getRAM(unsigned char *ram) const {
+	memcpy(ram, RAM, NES_RAM_SIZE);
+}
+
+const unsigned char *NESInterface::Impl::getRAMBuffer() const {
+	return RAM;
+}
+
+void NESInterface::Impl::getSpriteObservation(int *oam, unsigned char *line_sprites,
+                                              unsigned char *line_counts, int *scroll) const {
+
+	if (oam) {
+		// OAM holds each sprite's top line minus one.
+		for (int i = 0; i < NES_NUM_SPRITES; i++) {
+			const uint8 *entry = SPRAM + i * 4;
+			oam[i * 4 + 0] = entry[0] + 1;
+			oam[i * 4 + 1] = entry[1];
+			oam[i * 4 + 2] = entry[2];
+			oam[i * 4 + 3] = entry[3];
+		}
+	}
+
+	if (line_sprites) {
+		for (int line = 0; line < NES_SCREEN_LINES; line++) {
+			int count = FCEUPPU_LineSpriteCount[line];
+			unsigned char *out = line_sprites + line * NES_SPRITES_PER_LINE;
+			for (int i = 0; i < NES_SPRITES_PER_LINE; i++) {
+				out[i] = i < count ? FCEUPPU_LineSprites[line][i] : 0xFF;
+			}
+		}
+	}
+
+	if (line_counts) {
+		memcpy(line_counts, FCEUPPU_LineSpriteCount, NES_SCREEN_LINES);
+	}
+
+	if (scroll) {
+		scroll[0] = FCEUPPU_FrameScrollX;
+		scroll[1] = FCEUPPU_FrameScrollY;
+	}
+}
+
 void NESInterface::Impl::fillRGBfromPalette(unsigned char *raw_screen, unsigned char *rgb_screen, int raw_screen_size) {
 
-        unsigned long i;
-        for (i = 0; i<raw_screen_size; i++) {
-                unsigned char r, g, b;
-                NESInterface::getRGB(raw_screen[i], &r, &g, &b);
+        // Man, this bastard took a long time to figure out! The callers
+        // expect BGR.
+        m_palette.update();
+        m_palette.convert(raw_screen, rgb_screen, raw_screen_size, RGB_FORMAT_BGR24);
+}
 
-                // Man, this bastard took a long time to figure out!
-                rgb_screen[3*i] = b;
-                rgb_screen[(3*i)+1] = g;
-                rgb_screen[(3*i)+2] = r;
-        }
+void NESInterface::Impl::getScreenRGB(unsigned char *out, int out_size, int format) {
+
+	int num_pixels = getScreenWidth() * getScreenHeight();
+	int needed = num_pixels * PaletteLUT::getBytesPerPixel(format);
+	if (out_size < needed) {
+		printf("ERROR: RGB screen buffer too small (%d < %d).\n", out_size, needed);
+		return;
+	}
+	FCEUPPU_DrawLazyFrame();
+	m_palette.update();
+	m_palette.convert(XBuf, out, num_pixels, format);
+}
+
+bool NESInterface::Impl::setObservationFormat(int width, int height, bool grayscale,
+                                              int crop_top, int crop_bottom, int crop_left, int crop_right) {
+	return m_observation.configure(getScreenWidth(), getScreenHeight(), width, height, grayscale,
+			crop_top, crop_bottom, crop_left, crop_right);
+}
+
+int NESInterface::Impl::getObservationSize() const {
+	return m_observation.getSize();
+}
+
+void NESInterface::Impl::getObservation(unsigned char *obs, int obs_size) {
+
+	if (obs_size < getObservationSize()) {
+		printf("ERROR: Observation buffer too small (%d < %d).\n", obs_size, getObservationSize());
+		return;
+	}
+
+	// Same frame as getScreen, so crops are given in its coordinates.
+	FCEUPPU_DrawLazyFrame();
+	m_palette.update();
+	m_observation.updatePalette(m_palette);
+	m_observation.process(XBuf, obs);
 }
 
 void NESInterface::Impl::setMaxNumFrames(int newMax) {
@@ -229,27 +991,21 @@ int NESInterface::Impl::getFrameNumber() const {
 }
 
 int NESInterface::Impl::getNumLegalActions() {
-	return NUM_NES_LEGAL_ACTIONS;
+	return m_game.getLegalActions().size();
 }
 
 void NESInterface::Impl::getLegalActionSet(int legal_actions[]) {
-    
-	// All the things you can do in SMB...
-	legal_actions[0] = ACT_NOOP;
-	legal_actions[1] = ACT_A;
-	legal_actions[2] = ACT_B;
-	legal_actions[3] = ACT_UP;
-	legal_actions[4] = ACT_RIGHT;
-	legal_actions[5] = ACT_LEFT;
-	legal_actions[6] = ACT_DOWN;
-	legal_actions[7] = ACT_A_UP;
-	legal_actions[8] = ACT_A_RIGHT;
-	legal_actions[9] = ACT_A_LEFT;
-	legal_actions[10] = ACT_A_DOWN;
-	legal_actions[11] = ACT_B_UP;
-	legal_actions[12] = ACT_B_RIGHT;
-	legal_actions[13] = ACT_B_LEFT;
-	legal_actions[14] = ACT_B_DOWN;
+	const std::vector<int> &legal = m_game.getLegalActions();
+	std::copy(legal.begin(), legal.end(), legal_actions);
+}
+
+int NESInterface::Impl::getNumMinimalActions() {
+	return m_game.getMinimalActions().size();
+}
+
+void NESInterface::Impl::getMinimalActionSet(int minimal_actions[]) {
+	const std::vector<int> &minimal = m_game.getMinimalActions();
+	std::copy(minimal.begin(), minimal.end(), minimal_actions);
 }
 
 int NESInterface::Impl::minReward() const {
@@ -277,143 +1033,152 @@ const int NESInterface::Impl::getCurrentScore() const {
 }
 
 int NESInterface::Impl::act(int action) {
+	return act(action, 1, false);
+}
 
-	// Calculate lives.
-	remaining_lives = FCEU_CheatGetByte(0x075a);
-
-	// Update game state.
-	game_state = FCEU_CheatGetByte(0x0770);
-
-	// Set the action. No idea whether this will work with other input configurations!
-	switch (action) {
-
-		case ACT_NOOP:
-			nes_input = 0;
-			break;
-
-		case ACT_A:
-			nes_input = 1;
-			break;
-
-		case ACT_B:
-			nes_input = 2;
-			break;
-
-		case ACT_UP:
-			nes_input = 16;
-			break;
-
-		case ACT_RIGHT:
-			nes_input = 128;
-			break;
-
-		case ACT_LEFT:
-			nes_input = 64;
-			break;
-
-		case ACT_DOWN:
-			nes_input = 32;
-			break;
+int NESInterface::Impl::act(int action, int repeat, bool skip_sound) {
+	return actPorts(&action, 1, repeat, skip_sound);
+}
 
-		case ACT_A_UP:
-			nes_input = 17;
-			break;
+int NESInterface::Impl::actPlayers(int action1, int action2, int repeat, bool skip_sound) {
+	int actions[NES_NUM_PLAYERS] = { action1, action2 };
+	return actPorts(actions, NES_NUM_PLAYERS, repeat, skip_sound);
+}
 
-		case ACT_A_RIGHT:
-			nes_input = 129;
-			break;
+int NESInterface::Impl::step(int action, bool *done, unsigned char *screen, int screen_size) {
 
-		case ACT_A_LEFT:
-			nes_input = 65;
-			break;
+	int reward = 0;
+	if (action == ACT_RESET) {
+		reset_game();
+	} else {
+		reward = act(action);
+	}
+	*done = game_over();
+	if (screen) {
+		getScreen(screen, screen_size);
+	}
+	return reward;
+}
 
-		case ACT_A_DOWN:
-			nes_input = 33;
-			break;
+int NESInterface::Impl::actPorts(const int *actions, int num_players, int repeat, bool skip_sound) {
+
+	// Intermediate frames go through the frameskip path of the PPU so
+	// no pixels are drawn; only the last one is rendered for getScreen.
+	// Lazy frames ignore the frameskip path and are drawn on demand.
+	int reward = 0;
+	for (int i = 0; i < repeat; i++) {
+
+		for (int p = 0; p < NES_NUM_PLAYERS; p++) {
+			// Sticky actions: the previous input may stay down for the frame.
+			int frame_action = ACT_NOOP;
+			if (p < num_players) {
+				frame_action = actions[p];
+				if (m_sticky_threshold && nextRandom(&m_episode_rng) < m_sticky_threshold) {
+					frame_action = m_last_action[p];
+				}
+			}
+			setAction(p, frame_action);
+			m_last_action[p] = frame_action;
+		}
+
+		int skip = 0;
+		if (i < repeat - 1) {
+			skip = skip_sound ? 2 : 1;
+		}
+		reward += stepFrame(skip);
+	}
+	return reward;
+}
 
-		case ACT_B_UP:
-			nes_input = 18;
-			break;
+void NESInterface::Impl::setAction(int port, int action) {
 
-		case ACT_B_RIGHT:
-			nes_input = 130;
-			break;
+	int buttons = m_game.getButtons(action);
+	if (buttons < 0) {
+		printf("ERROR: Undefined action %d sent to act.\n", action);
+		buttons = 0;
+	}
 
-		case ACT_B_LEFT:
-			nes_input = 66;
-			break;
+	// The second gamepad reads the second byte of its word; the upper
+	// bytes belong to Four Score pads.
+	nes_input[port] = buttons << (8 * port);
+}
 
-		case ACT_B_DOWN:
-			nes_input = 34;
-			break;
+int NESInterface::Impl::stepFrame(int skip) {
 
-		case ACT_SELECT:
-			nes_input = 8;
-			break;
+	// Calculate lives.
+	remaining_lives = m_game.getLives();
 
-		default:
-			nes_input = 0;
-			printf("ERROR: Undefined action sent to nes_act!");
-			break;
-	}
+	// Update game state.
+	game_state = m_game.isTerminal();
 
 	uint8 *gfx;
 	int32 *sound;
 	int32 ssize;
-	static int fskipc = 0;
 
 	// Main loop.
 	episode_frame_number++;
-	FCEUI_Emulate(&gfx, &sound, &ssize, fskipc);
+	FCEUI_Emulate(&gfx, &sound, &ssize, skip);
+#ifndef HEADLESS
 	FCEUD_Update(gfx, sound, ssize);
+#endif
 
-	// Get score...
-	int new_score = (FCEU_CheatGetByte(0x07dd) * 1000000) +
-			(FCEU_CheatGetByte(0x07de) * 100000) +
-			(FCEU_CheatGetByte(0x07df) * 10000) +
-			(FCEU_CheatGetByte(0x07e0) * 1000) +
-			(FCEU_CheatGetByte(0x07e1) * 100) +
-			(FCEU_CheatGetByte(0x07e2) * 10);
-
-	// Calculate the change in x (this is the x position on the screen, not in the level).
-	int new_x = FCEU_CheatGetByte(0x0086);
-	int deltaX = new_x - current_x;
-	deltaX = deltaX * 5;
-
-	// Handle resets of level, etc.
-	if (abs(deltaX) > MAX_ALLOWED_X_CHANGE) {
-		deltaX = 0;
-		current_x = 0;
-	} 
-        current_x = new_x;
-
-	// Calculate the reward based on score.
-	int reward = new_score - current_game_score;
-
-	// Handle negative scores.
-	if (reward < 0) {
-			reward = 0;
-	}
-	current_game_score = new_score;
-
-	// Add reward based on position.
-        // Oh wow - now sure we want to do this :(
-	reward = reward + deltaX;
-
-	return reward;
+	// Get score and reward as the game descriptor defines them.
+	current_game_score = m_game.getScore();
+	return m_game.collectReward();
 }
 
 NESInterface::Impl::Impl(const std::string &rom_file) :
+    m_snapshot(),
     m_episode_score(0),
     m_display_active(false),
-	nes_input(0),
+	m_episode_seed(0),
+	m_episode_rng(1),
+	m_randomize_ram(false),
+	m_max_noops(0),
+	m_sticky_threshold(0),
+	m_lazy_rendering(false),
+	m_valid(true),
 	current_game_score(0),
-	current_x(0),
 	remaining_lives(0),
 	game_state(0),
 	episode_frame_number(0)
 {
 
+	CoreMutexLock lock;
+
+	for (int p = 0; p < NES_NUM_PLAYERS; p++) {
+		nes_input[p] = 0;
+		m_last_action[p] = ACT_NOOP;
+	}
+
+	// Give every instance its own sequence of episodes until seeded.
+	m_rng = 2463534242u + 0x9E3779B9u * s_num_instances;
+
+	// The core is already running: start from the state the ROM had
+	// right after it was loaded and swap in on first use. It cannot run
+	// another ROM, so an instance asking for one stays out of it.
+	if (s_num_instances > 0 && rom_file != s_rom_file) {
+		printf("ERROR: All NESInterface instances in a process must use the same ROM (%s).\n",
+				s_rom_file.c_str());
+		m_valid = false;
+		return;
+	}
+	if (s_num_instances++ > 0) {
+		m_context = s_boot_state;
+		initGame();
+		return;
+	}
+
+#ifdef HEADLESS
+	// No display, config files or drivers: bring up the core and load
+	// the ROM with the driver's built-in settings.
+	if(FCEUI_Initialize() != 1) {
+		printf("Error initializing FCEUI.\n");
+	}
+	if(LoadGame(rom_file.c_str()) != 1) {
+		printf("Error loading ROM.\n");
+	}
+#else
 	// Initialize some configuration variables.
 	static int inited = 0;
 	noGui = 1;
@@ -482,10 +1247,37 @@ NESInterface::Impl::Impl(const std::string &rom_file) :
 
 	// Set the emulation speed.
 	FCEUD_SetEmulationSpeed(EMUSPEED_FASTEST);
+#endif
 
 	// Set the emulator to read from nes_input instead of the Gamepad :)
-	FCEUI_SetInput(0, (ESI) SI_GAMEPAD, &nes_input, 0);
-	FCEUI_SetInput(1, (ESI) SI_GAMEPAD, &nes_input, 0);
+	FCEUI_SetInput(0, (ESI) SI_GAMEPAD, &nes_input[0], 0);
+	FCEUI_SetInput(1, (ESI) SI_GAMEPAD, &nes_input[1], 0);
+
+	initGame();
+
+	// Remember the power-on state for any further instances.
+	s_rom_file = rom_file;
+	serializeState();
+	s_boot_state.assign(m_snapshot.buf(), m_snapshot.buf() + m_snapshot.size());
+	s_current = this;
+}
+
+void NESInterface::Impl::initGame() {
+
+	m_game.loadForGame(iNESGameCRC32, md5_asciistr(GameInfo->MD5));
+	printf("Game descriptor: %s\n", m_game.getName().c_str());
+	setObservationFormat(84, 84, true, 0, 0, 0, 0);
+}
+
+bool NESInterface::Impl::loadGameDescriptor(const std::string &path) {
+
+	if (!m_game.loadFile(path)) {
+		return false;
+	}
+	if (!m_game.matches(iNESGameCRC32, md5_asciistr(GameInfo->MD5))) {
+		printf("WARNING: %s does not list the loaded ROM.\n", path.c_str());
+	}
+	return true;
 }
 
 /* --------------------------------------------------------------------------------------------------*/
@@ -493,30 +1285,123 @@ NESInterface::Impl::Impl(const std::string &rom_file) :
 /* begin PIMPL wrapper */
 
 bool NESInterface::loadState() {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return false;
     return m_pimpl->loadState();
 }
 
 bool NESInterface::gameOver() {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return false;
     return m_pimpl->game_over();
 }
 
 void NESInterface::resetGame() {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return;
     m_pimpl->reset_game();
 }
 
+void NESInterface::resetGame(unsigned int episode_seed) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return;
+    m_pimpl->reset_game(episode_seed);
+}
+
+void NESInterface::setSeed(unsigned int seed) {
+    CoreMutexLock lock;
+    m_pimpl->setSeed(seed);
+}
+
+unsigned int NESInterface::getEpisodeSeed() const {
+    CoreMutexLock lock;
+    return m_pimpl->getEpisodeSeed();
+}
+
+void NESInterface::setRandomizeRAM(bool randomize) {
+    CoreMutexLock lock;
+    m_pimpl->setRandomizeRAM(randomize);
+}
+
+void NESInterface::setNoopStarts(int max_noops) {
+    CoreMutexLock lock;
+    m_pimpl->setNoopStarts(max_noops);
+}
+
+void NESInterface::setRepeatActionProbability(float probability) {
+    CoreMutexLock lock;
+    m_pimpl->setRepeatActionProbability(probability);
+}
+
+void NESInterface::setLazyRendering(bool lazy) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return;
+    m_pimpl->setLazyRendering(lazy);
+}
+
 void NESInterface::saveState() {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return;
     m_pimpl->saveState();
 }
 
 std::string NESInterface::getSnapshot() const {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return std::string();
     return m_pimpl->getSnapshot();
 }
 
 void NESInterface::restoreSnapshot(const std::string snapshot) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return;
     m_pimpl->restoreSnapshot(snapshot);
 }
 
+int NESInterface::getSnapshotSize() const {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return 0;
+    return m_pimpl->getSnapshotSize();
+}
+
+int NESInterface::cloneState(unsigned char *buf, int buf_size) const {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return 0;
+    return m_pimpl->cloneState(buf, buf_size);
+}
+
+bool NESInterface::restoreState(const unsigned char *buf, int size) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return false;
+    return m_pimpl->restoreState(buf, size);
+}
+
+DeltaSnapshot *NESInterface::cloneDeltaState(DeltaSnapshot *parent, bool screen) const {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return NULL;
+    return m_pimpl->cloneDeltaState(parent, screen);
+}
+
+bool NESInterface::restoreDeltaState(const DeltaSnapshot *snapshot) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return false;
+    return m_pimpl->restoreDeltaState(snapshot);
+}
+
+void NESInterface::releaseDeltaState(DeltaSnapshot *snapshot) {
+    CoreMutexLock lock;
+    if (snapshot) {
+        snapshot->release();
+    }
+}
+
+int NESInterface::getDeltaStateMemory(const DeltaSnapshot *snapshot) {
+    CoreMutexLock lock;
+    return snapshot ? snapshot->getMemoryUsage() : 0;
+}
+
 void NESInterface::getScreen(unsigned char *screen, int screen_size) {
+         ContextGuard guard(m_pimpl);
+         if (!guard) return;
          m_pimpl->getScreen(screen, screen_size);
 }
 
@@ -528,10 +1413,104 @@ const int NESInterface::getScreenWidth() const {
 	return m_pimpl->getScreenWidth();
 }
 
+const unsigned char *NESInterface::getScreenBuffer() {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return NULL;
+    return m_pimpl->getScreenBuffer();
+}
+
+int NESInterface::getScreenStride() const {
+    return NES_SCREEN_WIDTH;
+}
+
+int NESInterface::getRAMSize() const {
+    return NES_RAM_SIZE;
+}
+
+void NESInterface::getRAM(unsigned char *ram) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return;
+    m_pimpl->getRAM(ram);
+}
+
+const unsigned char *NESInterface::getRAMBuffer() {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return NULL;
+    return m_pimpl->getRAMBuffer();
+}
+
+void NESInterface::getSpriteObservation(int *oam, unsigned char *line_sprites,
+                                        unsigned char *line_counts, int *scroll) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return;
+    m_pimpl->getSpriteObservation(oam, line_sprites, line_counts, scroll);
+}
+
 void NESInterface::fillRGBfromPalette(unsigned char *raw_screen, unsigned char *rgb_screen, int raw_screen_size) {
+        // The palette is shared by all instances, so no context swap is needed.
+        CoreMutexLock lock;
         m_pimpl->fillRGBfromPalette(raw_screen, rgb_screen, raw_screen_size);
 }
 
+void NESInterface::getScreenRGB(unsigned char *out, int out_size, int format) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return;
+    m_pimpl->getScreenRGB(out, out_size, format);
+}
+
+bool NESInterface::setObservationFormat(int width, int height, bool grayscale,
+                                        int crop_top, int crop_bottom, int crop_left, int crop_right) {
+    return m_pimpl->setObservationFormat(width, height, grayscale, crop_top, crop_bottom, crop_left, crop_right);
+}
+
+int NESInterface::getObservationSize() const {
+    return m_pimpl->getObservationSize();
+}
+
+void NESInterface::getObservation(unsigned char *obs, int obs_size) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return;
+    m_pimpl->getObservation(obs, obs_size);
+}
+
+bool NESInterface::loadGameDescriptor(const std::string &path) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return false;
+    return m_pimpl->loadGameDescriptor(path);
+}
+
+void NESInterface::generateStartPool(int num_states, int max_noops, unsigned int seed) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return;
+    m_pimpl->generateStartPool(num_states, max_noops, seed);
+}
+
+void NESInterface::addStartState() {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return;
+    m_pimpl->addStartState();
+}
+
+void NESInterface::clearStartPool() {
+    CoreMutexLock lock;
+    m_pimpl->clearStartPool();
+}
+
+int NESInterface::getStartPoolSize() const {
+    CoreMutexLock lock;
+    return m_pimpl->getStartPoolSize();
+}
+
+bool NESInterface::saveStartPool(const std::string &path) const {
+    CoreMutexLock lock;
+    return m_pimpl->saveStartPool(path);
+}
+
+bool NESInterface::loadStartPool(const std::string &path) {
+    CoreMutexLock lock;
+    return m_pimpl->loadStartPool(path);
+}
+
 void NESInterface::setMaxNumFrames(int newMax) {
     m_pimpl->setMaxNumFrames(newMax);
 }
@@ -552,6 +1531,14 @@ void NESInterface::getLegalActionSet(int legal_actions[]) {
         m_pimpl->getLegalActionSet(legal_actions);
 }
 
+int NESInterface::getNumMinimalActions() {
+	return m_pimpl->getNumMinimalActions();
+}
+
+void NESInterface::getMinimalActionSet(int minimal_actions[]) {
+        m_pimpl->getMinimalActionSet(minimal_actions);
+}
+
 int NESInterface::minReward() const {
     return m_pimpl->minReward();
 }
@@ -569,9 +1556,34 @@ const int NESInterface::getCurrentScore() const {
 }
 
 int NESInterface::act(int action) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return 0;
     return m_pimpl->act(action);
 }
 
+int NESInterface::act(int action, int repeat, bool skip_sound) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return 0;
+    return m_pimpl->act(action, repeat, skip_sound);
+}
+
+int NESInterface::actPlayers(int action1, int action2, int repeat, bool skip_sound) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) return 0;
+    return m_pimpl->actPlayers(action1, action2, repeat, skip_sound);
+}
+
+int NESInterface::step(int action, bool *done, unsigned char *screen, int screen_size) {
+    ContextGuard guard(m_pimpl);
+    if (!guard) { *done = false; return 0; }
+    return m_pimpl->step(action, done, screen, screen_size);
+}
+
+bool NESInterface::isValid() const {
+    CoreMutexLock lock;
+    return m_pimpl->isValid();
+}
+
 NESInterface::NESInterface(const std::string &rom_file) :
     m_pimpl(new NESInterface::Impl(rom_file)) {
 
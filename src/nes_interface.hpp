@@ -5,16 +5,37 @@
 #include <vector>
 #include <memory>
 #include <cassert>
-#include <SDL/SDL.h>
 
 namespace nes {
 
+class DeltaSnapshot;
+
 // NES screen width.
 #define NES_SCREEN_WIDTH 256
 
-// Number of normal game actions we want to test.
+// Size of the console's work RAM.
+#define NES_RAM_SIZE 0x800
+
+// Number of sprites in the PPU's object memory (OAM).
+#define NES_NUM_SPRITES 64
+
+// Number of sprites the PPU draws on one line.
+#define NES_SPRITES_PER_LINE 8
+
+// Number of lines the PPU renders.
+#define NES_SCREEN_LINES 240
+
+// Number of normal game actions we want to test, without the ones a game
+// descriptor adds.
 #define NUM_NES_LEGAL_ACTIONS 15
 
+// Number of action numbers every game has (ACT_NOOP to ACT_SELECT). Game
+// descriptors number their own actions from here on.
+#define NUM_NES_BUILTIN_ACTIONS 19
+
+// Number of gamepads, one per player.
+#define NES_NUM_PLAYERS 2
+
 // The amount of change in the position above which we disregard.
 #define MAX_ALLOWED_X_CHANGE 100
 
@@ -39,6 +60,11 @@ namespace nes {
 #define ACT_RANDOM    17
 #define ACT_SELECT    18 // 8
 
+// Pixel layouts for getScreenRGB.
+#define RGB_FORMAT_RGB24  0 // R, G, B
+#define RGB_FORMAT_BGR24  1 // B, G, R
+#define RGB_FORMAT_RGBA32 2 // R, G, B, 255
+
 typedef unsigned char byte_t;
 typedef unsigned char pixel_t;
 
@@ -47,7 +73,14 @@ class NESInterface {
 
     public:
 
-        /** create a NESInterface. This routine is not threadsafe!
+        /** create a NESInterface. Several instances may live in one
+            process and be called from different threads, but they share
+            one emulator core: their calls are serialized, never run at the
+            same time, and every switch to another instance saves the
+            machine state of the previous one and loads its own. This saves
+            processes, not time; NESVectorEnv and NESForkServer step
+            environments in parallel. All instances must use the same ROM; one created for
+            another ROM is invalid (see isValid).
             One also has the option of creating a single NES session
             that will randomly (uniform) alternate between a number of
             different ROM files. The syntax is:  
@@ -57,9 +90,55 @@ class NESInterface {
         /** Unload the emulator. */
         ~NESInterface();
 
-        /** Resets the game. */
+        /** Returns false if the instance could not join the emulator core
+            because it asked for another ROM than the instances already
+            running. An invalid instance ignores every call: act returns 0
+            and nothing is written to the caller's buffers. */
+        bool isValid() const;
+
+        /** Resets the game. The state reached by the first reset is kept
+            in memory and later resets restore it directly. The cache is
+            dropped when the ROM, region or game descriptor changes. The
+            episode gets a seed drawn from the generator setSeed seeds. */
         void resetGame();
 
+        /** Resets the game into the episode with the given seed, as
+            returned by getEpisodeSeed. The seed drives all randomness of
+            the episode (power-on RAM, no-op starts, start pool choice and
+            sticky actions), so a seed and the actions taken replay an
+            episode exactly. */
+        void resetGame(unsigned int episode_seed);
+
+        /** Seeds the generator the episode seeds of resetGame() are drawn
+            from. Unseeded instances each get a different fixed seed. */
+        void setSeed(unsigned int seed);
+
+        /** Returns the seed of the current episode. */
+        unsigned int getEpisodeSeed() const;
+
+        /** If set, every reset power-cycles the console with RAM filled
+            from the episode seed, then plays the start sequence. Resets
+            are then much slower as the start state cannot be cached. */
+        void setRandomizeRAM(bool randomize);
+
+        /** Plays 0 to max_noops (uniformly at random) NOOP frames after
+            every reset. 0 turns it off. */
+        void setNoopStarts(int max_noops);
+
+        /** Sets the probability that each emulated frame keeps the
+            previous frame's input instead of the requested action. */
+        void setRepeatActionProbability(float probability);
+
+        /** If set, frames are not drawn while they are emulated. The PPU
+            logs what each line needs and the last frame is drawn from the
+            log only when the screen is read (getScreen, getObservation,
+            ...) or a state is saved. Emulation, including sprite 0 hits
+            and mapper IRQs, is the same as with drawing, so frames skipped
+            by act also become exact instead of taking the frameskip path.
+            Off by default; mappers that watch the PPU's fetches (MMC2,
+            MMC4, MMC5) are always drawn. */
+        void setLazyRendering(bool lazy);
+
         /** Indicates if the game has ended. */
         bool gameOver();
 
@@ -68,12 +147,38 @@ class NESInterface {
             buttons on the game over screen. */
         int act(int action);
 
+        /** Applies an action for repeat frames and returns the summed reward.
+            Only the last frame is rendered; the others take the emulator's
+            frameskip path, which also skips sound if skip_sound is set.
+            With lazy rendering no frame is drawn until it is looked at. */
+        int act(int action, int repeat, bool skip_sound = false);
+
+        /** Like act, but the first gamepad plays action1 and the second
+            action2. act leaves the second gamepad idle. With sticky actions
+            each gamepad may repeat its own previous action. */
+        int actPlayers(int action1, int action2, int repeat = 1, bool skip_sound = false);
+
+        /** Applies an action (or resets the game on ACT_RESET), stores
+            whether the game has ended in done and, if screen is not NULL,
+            copies the screen into it. Returns the reward. Unlike separate
+            act, gameOver and getScreen calls, this switches the shared
+            emulator core to this instance only once. */
+        int step(int action, bool *done, unsigned char *screen = NULL, int screen_size = 0);
+
         /** Returns the number of legal actions. */
         int getNumLegalActions();
 
-        /** Returns the vector of legal actions. */
+        /** Returns the vector of legal actions: the built-in ones followed
+            by those the game descriptor defines. */
         void getLegalActionSet(int legal_actions[]);
 
+        /** Returns the number of actions in the minimal action set. */
+        int getNumMinimalActions();
+
+        /** Returns the actions the game needs, as its descriptor lists
+            them; the legal actions if it does not. */
+        void getMinimalActionSet(int minimal_actions[]);
+
         /** Returns the frame number since the loading of the ROM. */
         int getFrameNumber() const;
 
@@ -99,10 +204,88 @@ class NESInterface {
         const int getScreenHeight() const;
         const int getScreenWidth() const;
 
+        /** Returns the emulator's frame buffer, the memory getScreen copies
+            from, so it can be read without copying. Rows are
+            getScreenStride() bytes apart. The pointer stays valid as long
+            as any instance lives, but the buffer holds the frame of
+            whichever instance ran last: with several instances in one
+            process use getScreen instead. With lazy rendering the buffer
+            is only brought up to date by reading the screen, e.g. by
+            calling this again. */
+        const unsigned char *getScreenBuffer();
+
+        /** Returns the distance in bytes between rows of getScreenBuffer. */
+        int getScreenStride() const;
+
+        /** Returns the size of the console's work RAM. */
+        int getRAMSize() const;
+
+        /** Copies the console's work RAM into ram, which must hold
+            getRAMSize() bytes. */
+        void getRAM(unsigned char *ram);
+
+        /** Returns the console's work RAM without copying. The same caveats
+            as for getScreenBuffer apply. */
+        const unsigned char *getRAMBuffer();
+
+        /** Writes what the PPU knows about the sprites, for agents that do
+            not need pixels. Any of the buffers may be NULL.
+            oam: NES_NUM_SPRITES * 4 ints, the object memory decoded as
+                 (y, tile, attributes, x) per sprite, y being the first
+                 screen line the sprite covers.
+            line_sprites: NES_SCREEN_LINES * NES_SPRITES_PER_LINE bytes,
+                 the OAM indices of the sprites drawn on each line of the
+                 last frame in priority order, 255 in unused slots.
+            line_counts: NES_SCREEN_LINES bytes, the number of sprites on
+                 each line; above NES_SPRITES_PER_LINE only if the sprite
+                 limit is disabled, in which case the rest are not listed.
+            scroll: 2 ints, the x and y scroll the last frame started with,
+                 counting the right and lower nametables from 256 and 240.
+            The lines and scroll are empty after a state is restored until
+            the next frame is emulated. */
+        void getSpriteObservation(int *oam, unsigned char *line_sprites,
+                                  unsigned char *line_counts, int *scroll);
+
         /** Returns the score. */
         const int getCurrentScore() const;
 
-        /** Saves the state of the emulator system, overwriting any 
+        /** Replaces the rules for score, reward, lives and game over with a
+            game descriptor file (see nes_game_descriptor.hpp for the
+            format). By default the first *.game file in $NES_GAMES_PATH
+            that lists the ROM's CRC32 or MD5 is used, or the built-in
+            Super Mario Bros. rules if there is none. Returns false if the
+            file could not be read; the rules are then left unchanged.
+            States saved or cloned before the change carry the old rules'
+            reward baselines and no longer restore if their number differs. */
+        bool loadGameDescriptor(const std::string &path);
+
+        /** Fills the start pool with num_states states, each reached by
+            playing 0 to max_noops NOOP frames (uniformly at random, from
+            seed) after a reset. While the pool is not empty, resetGame
+            restores one of its states picked uniformly at random. The pool
+            is shared by all instances in the process. The current state and
+            the sequence of episode seeds are left as they were. Negative
+            arguments are rejected. */
+        void generateStartPool(int num_states, int max_noops, unsigned int seed);
+
+        /** Adds the current state to the start pool, e.g. after scripting
+            the way to a particular level. */
+        void addStartState();
+
+        /** Empties the start pool, so resets go back to the plain start state. */
+        void clearStartPool();
+
+        /** Returns the number of states in the start pool. */
+        int getStartPoolSize() const;
+
+        /** Writes the start pool to a file, compressed. */
+        bool saveStartPool(const std::string &path) const;
+
+        /** Replaces the start pool with one written by saveStartPool. Fails
+            if the pool was made for another ROM, region or game descriptor. */
+        bool loadStartPool(const std::string &path);
+
+        /** Saves the state of the emulator system in memory, overwriting any 
             previously saved state. */
         void saveState();
 
@@ -116,6 +299,43 @@ class NESInterface {
 
         /** Sets the state from a string*/
         void restoreSnapshot(const std::string snapshot);
+
+        /** Returns the size in bytes of a serialized state. The size is
+            fixed for a given ROM, so callers can allocate once. */
+        int getSnapshotSize() const;
+
+        /** Writes the current state into buf without touching disk.
+            The state includes the episode's sticky-action randomness, so
+            restoring it replays the same draws. Returns the number of
+            bytes written, or 0 if buf_size is too small. */
+        int cloneState(unsigned char *buf, int buf_size) const;
+
+        /** Restores a state previously written by cloneState. Returns
+            false if the data could not be loaded or was written under a game
+            descriptor with a different number of reward baselines. */
+        bool restoreState(const unsigned char *buf, int size);
+
+        /** Takes an in-memory snapshot that only stores what changed
+            since parent, a snapshot from an earlier call (or NULL for a
+            full one). Meant for tree search: children of one node share
+            everything they did not change. Snapshots are reference
+            counted and must be freed with releaseDeltaState; a parent may
+            be released before its children. The screen is left out unless
+            screen is set, in which case a full copy is kept with the
+            snapshot. */
+        DeltaSnapshot *cloneDeltaState(DeltaSnapshot *parent = NULL, bool screen = false) const;
+
+        /** Restores a snapshot taken by cloneDeltaState. The screen is
+            blank until the next frame if the snapshot was taken without
+            it. Returns false if the data could not be loaded. */
+        bool restoreDeltaState(const DeltaSnapshot *snapshot);
+
+        /** Frees a snapshot taken by cloneDeltaState. */
+        static void releaseDeltaState(DeltaSnapshot *snapshot);
+
+        /** Returns the bytes held by a snapshot, not counting what it
+            shares with others. */
+        static int getDeltaStateMemory(const DeltaSnapshot *snapshot);
         
         /** Converts a pixel to its RGB value. */
         static void getRGB(
@@ -125,9 +345,31 @@ class NESInterface {
             unsigned char *blue
         );
 
-        /** Get the full RGB screen from the raw pixel data. */
+        /** Get the full RGB screen from the raw pixel data, as BGR triplets. */
         void fillRGBfromPalette(unsigned char *raw_screen, unsigned char *rgb_screen, int raw_screen_size);
 
+        /** Writes the current screen in colour using one of the RGB_FORMAT_*
+            layouts. out_size must be at least width * height * 3 bytes,
+            or * 4 for RGB_FORMAT_RGBA32. */
+        void getScreenRGB(unsigned char *out, int out_size, int format = RGB_FORMAT_RGB24);
+
+        /** Sets the format of getObservation. The screen (as returned by
+            getScreen) is cropped by the given number of pixels on each side,
+            area-averaged down to width x height and stored as one luminance
+            byte per pixel if grayscale is set, or as RGB triplets otherwise.
+            The default is 84x84 grayscale without cropping. Returns false
+            if the crop is smaller than the requested size. */
+        bool setObservationFormat(int width, int height, bool grayscale,
+                                  int crop_top = 0, int crop_bottom = 0,
+                                  int crop_left = 0, int crop_right = 0);
+
+        /** Returns the size in bytes of an observation. */
+        int getObservationSize() const;
+
+        /** Writes the current screen, preprocessed as set by
+            setObservationFormat, into obs. */
+        void getObservation(unsigned char *obs, int obs_size);
+
     private:
 
         /** Copying is explicitly disallowed. */
@@ -137,6 +379,7 @@ class NESInterface {
         NESInterface &operator=(const NESInterface &);
 
         class Impl;
+        class ContextGuard;
         Impl *m_pimpl;
 };
 
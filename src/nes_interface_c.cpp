@@ -8,10 +8,42 @@ void delete_NES(nes::NESInterface *nes) {
         delete nes;
 }
 
+bool isValid(nes::NESInterface *nes) {
+        return nes->isValid();
+}
+
 void resetGame(nes::NESInterface *nes) {
         nes->resetGame();
 }
 
+void resetGameWithSeed(nes::NESInterface *nes, unsigned int episode_seed) {
+        nes->resetGame(episode_seed);
+}
+
+void setSeed(nes::NESInterface *nes, unsigned int seed) {
+        nes->setSeed(seed);
+}
+
+unsigned int getEpisodeSeed(nes::NESInterface *nes) {
+        return nes->getEpisodeSeed();
+}
+
+void setRandomizeRAM(nes::NESInterface *nes, bool randomize) {
+        nes->setRandomizeRAM(randomize);
+}
+
+void setNoopStarts(nes::NESInterface *nes, int max_noops) {
+        nes->setNoopStarts(max_noops);
+}
+
+void setRepeatActionProbability(nes::NESInterface *nes, float probability) {
+        nes->setRepeatActionProbability(probability);
+}
+
+void setLazyRendering(nes::NESInterface *nes, bool lazy) {
+        nes->setLazyRendering(lazy);
+}
+
 bool gameOver(nes::NESInterface *nes) {
         return nes->gameOver();
 }
@@ -20,6 +52,14 @@ int act(nes::NESInterface *nes, int action) {
         return nes->act(action);
 }
 
+int actRepeat(nes::NESInterface *nes, int action, int repeat, bool skip_sound) {
+        return nes->act(action, repeat, skip_sound);
+}
+
+int actPlayers(nes::NESInterface *nes, int action1, int action2, int repeat, bool skip_sound) {
+        return nes->actPlayers(action1, action2, repeat, skip_sound);
+}
+
 int getNumLegalActions(nes::NESInterface *nes) {
         return nes->getNumLegalActions();
 }
@@ -28,6 +68,14 @@ void getLegalActionSet(nes::NESInterface *nes, int legal_actions[]) {
         nes->getLegalActionSet(legal_actions);
 }
 
+int getNumMinimalActions(nes::NESInterface *nes) {
+        return nes->getNumMinimalActions();
+}
+
+void getMinimalActionSet(nes::NESInterface *nes, int minimal_actions[]) {
+        nes->getMinimalActionSet(minimal_actions);
+}
+
 int getFrameNumber(nes::NESInterface *nes) {
         return nes->getFrameNumber();
 }
@@ -56,6 +104,34 @@ void getScreen(nes::NESInterface *nes, unsigned char *screen, int screen_size) {
         nes->getScreen(screen, screen_size);
 }
 
+bool loadGameDescriptor(nes::NESInterface *nes, char *path) {
+        return nes->loadGameDescriptor(path);
+}
+
+void generateStartPool(nes::NESInterface *nes, int num_states, int max_noops, unsigned int seed) {
+        nes->generateStartPool(num_states, max_noops, seed);
+}
+
+void addStartState(nes::NESInterface *nes) {
+        nes->addStartState();
+}
+
+void clearStartPool(nes::NESInterface *nes) {
+        nes->clearStartPool();
+}
+
+int getStartPoolSize(nes::NESInterface *nes) {
+        return nes->getStartPoolSize();
+}
+
+bool saveStartPool(nes::NESInterface *nes, char *path) {
+        return nes->saveStartPool(path);
+}
+
+bool loadStartPool(nes::NESInterface *nes, char *path) {
+        return nes->loadStartPool(path);
+}
+
 int getScreenHeight(nes::NESInterface *nes) {
         return nes->getScreenHeight();
 }
@@ -64,6 +140,31 @@ int getScreenWidth(nes::NESInterface *nes) {
         return nes->getScreenWidth();
 }
 
+const unsigned char *getScreenBuffer(nes::NESInterface *nes) {
+        return nes->getScreenBuffer();
+}
+
+int getScreenStride(nes::NESInterface *nes) {
+        return nes->getScreenStride();
+}
+
+int getRAMSize(nes::NESInterface *nes) {
+        return nes->getRAMSize();
+}
+
+void getRAM(nes::NESInterface *nes, unsigned char *ram) {
+        nes->getRAM(ram);
+}
+
+const unsigned char *getRAMBuffer(nes::NESInterface *nes) {
+        return nes->getRAMBuffer();
+}
+
+void getSpriteObservation(nes::NESInterface *nes, int *oam, unsigned char *line_sprites,
+                          unsigned char *line_counts, int *scroll) {
+        nes->getSpriteObservation(oam, line_sprites, line_counts, scroll);
+}
+
 int getCurrentScore(nes::NESInterface *nes) {
         return nes->getCurrentScore();
 }
@@ -76,14 +177,136 @@ bool loadState(nes::NESInterface *nes) {
         return nes->loadState();
 }
 
-std::string getSnapshot(nes::NESInterface *nes) {
-        return nes->getSnapshot();
+int getSnapshot(nes::NESInterface *nes, char *snapshot, int size) {
+        return nes->cloneState((unsigned char *) snapshot, size);
+}
+
+void restoreSnapshot(nes::NESInterface *nes, char *snapshot, int size) {
+        nes->restoreSnapshot(std::string(snapshot, size > 0 ? size : 0));
+}
+
+int getSnapshotSize(nes::NESInterface *nes) {
+        return nes->getSnapshotSize();
+}
+
+int cloneState(nes::NESInterface *nes, unsigned char *buf, int buf_size) {
+        return nes->cloneState(buf, buf_size);
+}
+
+bool restoreState(nes::NESInterface *nes, unsigned char *buf, int size) {
+        return nes->restoreState(buf, size);
+}
+
+nes::DeltaSnapshot *cloneDeltaState(nes::NESInterface *nes, nes::DeltaSnapshot *parent, bool screen) {
+        return nes->cloneDeltaState(parent, screen);
+}
+
+bool restoreDeltaState(nes::NESInterface *nes, nes::DeltaSnapshot *snapshot) {
+        return nes->restoreDeltaState(snapshot);
 }
 
-void restoreSnapshot(nes::NESInterface *nes, char *snapshot) {
-        nes->restoreSnapshot(snapshot);
+void releaseDeltaState(nes::DeltaSnapshot *snapshot) {
+        nes::NESInterface::releaseDeltaState(snapshot);
+}
+
+int getDeltaStateMemory(nes::DeltaSnapshot *snapshot) {
+        return nes::NESInterface::getDeltaStateMemory(snapshot);
 }
 
 void fillRGBfromPalette(nes::NESInterface *nes, unsigned char *raw_screen, unsigned char *rgb_screen, int raw_screen_size) {
         nes->fillRGBfromPalette(raw_screen, rgb_screen, raw_screen_size);
 }
+
+void getScreenRGB(nes::NESInterface *nes, unsigned char *out, int out_size, int format) {
+        nes->getScreenRGB(out, out_size, format);
+}
+
+bool setObservationFormat(nes::NESInterface *nes, int width, int height, bool grayscale,
+                          int crop_top, int crop_bottom, int crop_left, int crop_right) {
+        return nes->setObservationFormat(width, height, grayscale, crop_top, crop_bottom, crop_left, crop_right);
+}
+
+int getObservationSize(nes::NESInterface *nes) {
+        return nes->getObservationSize();
+}
+
+void getObservation(nes::NESInterface *nes, unsigned char *obs, int obs_size) {
+        nes->getObservation(obs, obs_size);
+}
+
+nes::NESVectorEnv *NESVectorEnv(char* ROM, int num_envs, int num_workers) {
+        return new nes::NESVectorEnv(ROM, num_envs, num_workers);
+}
+
+void delete_NESVectorEnv(nes::NESVectorEnv *vec) {
+        delete vec;
+}
+
+bool vectorIsReady(nes::NESVectorEnv *vec) {
+        return vec->isReady();
+}
+
+int getNumEnvs(nes::NESVectorEnv *vec) {
+        return vec->getNumEnvs();
+}
+
+int getBatchScreenSize(nes::NESVectorEnv *vec) {
+        return vec->getScreenSize();
+}
+
+void resetAll(nes::NESVectorEnv *vec) {
+        vec->resetAll();
+}
+
+bool actBatch(nes::NESVectorEnv *vec, int *actions, int *rewards, bool *dones, unsigned char *screens) {
+        return vec->act(actions, rewards, dones, screens);
+}
+
+void sendBatch(nes::NESVectorEnv *vec, int *env_ids, int *actions, int count) {
+        vec->send(env_ids, actions, count);
+}
+
+int recvBatch(nes::NESVectorEnv *vec, int *env_ids, int *rewards, bool *dones, unsigned char *screens,
+              int max_count, int min_count) {
+        return vec->recv(env_ids, rewards, dones, screens, max_count, min_count);
+}
+
+nes::NESForkServer *NESForkServer(char* ROM, int num_envs, int obs_width, int obs_height, bool grayscale) {
+        return new nes::NESForkServer(ROM, num_envs, obs_width, obs_height, grayscale);
+}
+
+void delete_NESForkServer(nes::NESForkServer *server) {
+        delete server;
+}
+
+bool forkIsReady(nes::NESForkServer *server) {
+        return server->isReady();
+}
+
+int getForkNumEnvs(nes::NESForkServer *server) {
+        return server->getNumEnvs();
+}
+
+int getForkFrameSize(nes::NESForkServer *server) {
+        return server->getFrameSize();
+}
+
+void forkResetAll(nes::NESForkServer *server) {
+        server->resetAll();
+}
+
+bool forkAct(nes::NESForkServer *server, int *actions) {
+        return server->act(actions);
+}
+
+const int *getForkRewards(nes::NESForkServer *server) {
+        return server->getRewards();
+}
+
+const bool *getForkDones(nes::NESForkServer *server) {
+        return server->getDones();
+}
+
+const unsigned char *getForkFrames(nes::NESForkServer *server) {
+        return server->getFrames();
+}
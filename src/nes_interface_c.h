@@ -7,6 +7,8 @@
 */
 
 #include "nes_interface.hpp"
+#include "nes_vector_env.hpp"
+#include "nes_fork_server.hpp"
 
 extern "C" {
 
@@ -14,16 +16,40 @@ extern "C" {
 
         void delete_NES(nes::NESInterface *nes);
 
+        bool isValid(nes::NESInterface *nes);
+
         void resetGame(nes::NESInterface *nes);
 
+        void resetGameWithSeed(nes::NESInterface *nes, unsigned int episode_seed);
+
+        void setSeed(nes::NESInterface *nes, unsigned int seed);
+
+        unsigned int getEpisodeSeed(nes::NESInterface *nes);
+
+        void setRandomizeRAM(nes::NESInterface *nes, bool randomize);
+
+        void setNoopStarts(nes::NESInterface *nes, int max_noops);
+
+        void setRepeatActionProbability(nes::NESInterface *nes, float probability);
+
+        void setLazyRendering(nes::NESInterface *nes, bool lazy);
+
         bool gameOver(nes::NESInterface *nes);
 
         int act(nes::NESInterface *nes, int action);
+
+        int actRepeat(nes::NESInterface *nes, int action, int repeat, bool skip_sound);
+
+        int actPlayers(nes::NESInterface *nes, int action1, int action2, int repeat, bool skip_sound);
         
         int getNumLegalActions(nes::NESInterface *nes);
 
         void getLegalActionSet(nes::NESInterface *nes, int legal_actions[]);
 
+        int getNumMinimalActions(nes::NESInterface *nes);
+
+        void getMinimalActionSet(nes::NESInterface *nes, int minimal_actions[]);
+
         int getFrameNumber(nes::NESInterface *nes);
 
         void setMaxNumFrames(nes::NESInterface *nes, int max_frames);
@@ -40,20 +66,111 @@ extern "C" {
 
         int getScreenHeight(nes::NESInterface *nes);
 
+        bool loadGameDescriptor(nes::NESInterface *nes, char *path);
+
+        void generateStartPool(nes::NESInterface *nes, int num_states, int max_noops, unsigned int seed);
+
+        void addStartState(nes::NESInterface *nes);
+
+        void clearStartPool(nes::NESInterface *nes);
+
+        int getStartPoolSize(nes::NESInterface *nes);
+
+        bool saveStartPool(nes::NESInterface *nes, char *path);
+
+        bool loadStartPool(nes::NESInterface *nes, char *path);
+
         int getScreenWidth(nes::NESInterface *nes);
 
+        const unsigned char *getScreenBuffer(nes::NESInterface *nes);
+
+        int getScreenStride(nes::NESInterface *nes);
+
+        int getRAMSize(nes::NESInterface *nes);
+
+        void getRAM(nes::NESInterface *nes, unsigned char *ram);
+
+        const unsigned char *getRAMBuffer(nes::NESInterface *nes);
+
+        void getSpriteObservation(nes::NESInterface *nes, int *oam, unsigned char *line_sprites,
+                                  unsigned char *line_counts, int *scroll);
+
         int getCurrentScore(nes::NESInterface *nes);
 
         void saveState(nes::NESInterface *nes);
 
         bool loadState(nes::NESInterface *nes);
 
-        std::string getSnapshot(nes::NESInterface *nes);
+        // Snapshots are binary, so they are passed with their size. getSnapshot
+        // returns the bytes written, or 0 if size is below getSnapshotSize.
+        int getSnapshot(nes::NESInterface *nes, char *snapshot, int size);
+
+        void restoreSnapshot(nes::NESInterface *nes, char *snapshot, int size);
+
+        int getSnapshotSize(nes::NESInterface *nes);
+
+        int cloneState(nes::NESInterface *nes, unsigned char *buf, int buf_size);
 
-        void restoreSnapshot(nes::NESInterface *nes, char *snapshot);
+        bool restoreState(nes::NESInterface *nes, unsigned char *buf, int size);
+
+        nes::DeltaSnapshot *cloneDeltaState(nes::NESInterface *nes, nes::DeltaSnapshot *parent, bool screen);
+
+        bool restoreDeltaState(nes::NESInterface *nes, nes::DeltaSnapshot *snapshot);
+
+        void releaseDeltaState(nes::DeltaSnapshot *snapshot);
+
+        int getDeltaStateMemory(nes::DeltaSnapshot *snapshot);
 
         void fillRGBfromPalette(nes::NESInterface *nes, unsigned char *raw_screen, unsigned char *rgb_screen, int raw_screen_size);
 
+        void getScreenRGB(nes::NESInterface *nes, unsigned char *out, int out_size, int format);
+
+        bool setObservationFormat(nes::NESInterface *nes, int width, int height, bool grayscale,
+                                  int crop_top, int crop_bottom, int crop_left, int crop_right);
+
+        int getObservationSize(nes::NESInterface *nes);
+
+        void getObservation(nes::NESInterface *nes, unsigned char *obs, int obs_size);
+
+        nes::NESVectorEnv *NESVectorEnv(char* ROM, int num_envs, int num_workers);
+
+        void delete_NESVectorEnv(nes::NESVectorEnv *vec);
+
+        bool vectorIsReady(nes::NESVectorEnv *vec);
+
+        int getNumEnvs(nes::NESVectorEnv *vec);
+
+        int getBatchScreenSize(nes::NESVectorEnv *vec);
+
+        void resetAll(nes::NESVectorEnv *vec);
+
+        bool actBatch(nes::NESVectorEnv *vec, int *actions, int *rewards, bool *dones, unsigned char *screens);
+
+        void sendBatch(nes::NESVectorEnv *vec, int *env_ids, int *actions, int count);
+
+        int recvBatch(nes::NESVectorEnv *vec, int *env_ids, int *rewards, bool *dones, unsigned char *screens,
+                      int max_count, int min_count);
+
+        nes::NESForkServer *NESForkServer(char* ROM, int num_envs, int obs_width, int obs_height, bool grayscale);
+
+        void delete_NESForkServer(nes::NESForkServer *server);
+
+        bool forkIsReady(nes::NESForkServer *server);
+
+        int getForkNumEnvs(nes::NESForkServer *server);
+
+        int getForkFrameSize(nes::NESForkServer *server);
+
+        void forkResetAll(nes::NESForkServer *server);
+
+        bool forkAct(nes::NESForkServer *server, int *actions);
+
+        const int *getForkRewards(nes::NESForkServer *server);
+
+        const bool *getForkDones(nes::NESForkServer *server);
+
+        const unsigned char *getForkFrames(nes::NESForkServer *server);
+
 } // extern "C"
 
 #endif // NES_INTERFACE_C_H
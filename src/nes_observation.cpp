@@ -0,0 +1,155 @@
+#include "nes_observation.hpp"
+#include "nes_palette.hpp"
+#include <stdio.h>
+
+namespace nes {
+
+ObservationProcessor::ObservationProcessor() :
+    m_src_width(0),
+    m_width(0),
+    m_height(0),
+    m_grayscale(true),
+    m_crop_top(0),
+    m_crop_left(0),
+    m_palette_serial(0)
+{
+	for (int i = 0; i < 256; i++) {
+		m_luma[i] = 0;
+		m_rgb[i][0] = m_rgb[i][1] = m_rgb[i][2] = 0;
+	}
+}
+
+bool ObservationProcessor::configure(int src_width, int src_height, int width, int height, bool grayscale,
+                                     int crop_top, int crop_bottom, int crop_left, int crop_right) {
+
+	int crop_width = src_width - crop_left - crop_right;
+	int crop_height = src_height - crop_top - crop_bottom;
+	if (crop_top < 0 || crop_bottom < 0 || crop_left < 0 || crop_right < 0 ||
+	    width < 1 || height < 1 || crop_width < width || crop_height < height) {
+		printf("ERROR: Cannot average a %dx%d crop down to %dx%d.\n", crop_width, crop_height, width, height);
+		return false;
+	}
+
+	m_src_width = src_width;
+	m_width = width;
+	m_height = height;
+	m_grayscale = grayscale;
+	m_crop_top = crop_top;
+	m_crop_left = crop_left;
+
+	// Every output pixel averages the box of source pixels it covers. The
+	// boxes are rounded to whole pixels so every source pixel is used once.
+	m_col_start.resize(width + 1);
+	for (int i = 0; i <= width; i++) {
+		m_col_start[i] = i * crop_width / width;
+	}
+	m_row_start.resize(height + 1);
+	for (int i = 0; i <= height; i++) {
+		m_row_start[i] = i * crop_height / height;
+	}
+	m_acc.resize(grayscale ? crop_width : 3 * crop_width);
+	return true;
+}
+
+int ObservationProcessor::getSize() const {
+	return m_width * m_height * (m_grayscale ? 1 : 3);
+}
+
+void ObservationProcessor::updatePalette(const PaletteLUT &palette) {
+
+	if (m_palette_serial == palette.getSerial()) {
+		return;
+	}
+
+	for (int i = 0; i < 256; i++) {
+		const unsigned char *color = palette.getColor(i);
+		unsigned int r = color[0], g = color[1], b = color[2];
+		m_rgb[i][0] = r;
+		m_rgb[i][1] = g;
+		m_rgb[i][2] = b;
+		// ITU-R BT.601 luma in 8.8 fixed point.
+		m_luma[i] = (77 * r + 150 * g + 29 * b + 128) >> 8;
+	}
+	m_palette_serial = palette.getSerial();
+}
+
+void ObservationProcessor::process(const unsigned char *screen, unsigned char *obs) {
+	if (m_grayscale) {
+		processGray(screen, obs);
+	} else {
+		processRGB(screen, obs);
+	}
+}
+
+// The palette lookup is a gather, so the inner loops are kept free of
+// branches and aliasing (plain 32-bit tables and accumulators) for the
+// compiler to vectorize where the target has gather instructions.
+void ObservationProcessor::processGray(const unsigned char *screen, unsigned char *obs) {
+
+	int crop_width = m_acc.size();
+	unsigned int *acc = &m_acc[0];
+	const unsigned int *luma = m_luma;
+
+	for (int oy = 0; oy < m_height; oy++) {
+		for (int x = 0; x < crop_width; x++) {
+			acc[x] = 0;
+		}
+
+		int y0 = m_row_start[oy], y1 = m_row_start[oy + 1];
+		for (int y = y0; y < y1; y++) {
+			const unsigned char *src = screen + (m_crop_top + y) * m_src_width + m_crop_left;
+			for (int x = 0; x < crop_width; x++) {
+				acc[x] += luma[src[x]];
+			}
+		}
+
+		for (int ox = 0; ox < m_width; ox++) {
+			int x0 = m_col_start[ox], x1 = m_col_start[ox + 1];
+			unsigned int sum = 0;
+			for (int x = x0; x < x1; x++) {
+				sum += acc[x];
+			}
+			unsigned int area = (x1 - x0) * (y1 - y0);
+			*obs++ = (sum + area / 2) / area;
+		}
+	}
+}
+
+void ObservationProcessor::processRGB(const unsigned char *screen, unsigned char *obs) {
+
+	int crop_width = m_acc.size() / 3;
+	unsigned int *acc = &m_acc[0];
+
+	for (int oy = 0; oy < m_height; oy++) {
+		for (int x = 0; x < 3 * crop_width; x++) {
+			acc[x] = 0;
+		}
+
+		int y0 = m_row_start[oy], y1 = m_row_start[oy + 1];
+		for (int y = y0; y < y1; y++) {
+			const unsigned char *src = screen + (m_crop_top + y) * m_src_width + m_crop_left;
+			for (int x = 0; x < crop_width; x++) {
+				const unsigned int *rgb = m_rgb[src[x]];
+				acc[3 * x] += rgb[0];
+				acc[3 * x + 1] += rgb[1];
+				acc[3 * x + 2] += rgb[2];
+			}
+		}
+
+		for (int ox = 0; ox < m_width; ox++) {
+			int x0 = m_col_start[ox], x1 = m_col_start[ox + 1];
+			unsigned int r = 0, g = 0, b = 0;
+			for (int x = x0; x < x1; x++) {
+				r += acc[3 * x];
+				g += acc[3 * x + 1];
+				b += acc[3 * x + 2];
+			}
+			unsigned int area = (x1 - x0) * (y1 - y0);
+			*obs++ = (r + area / 2) / area;
+			*obs++ = (g + area / 2) / area;
+			*obs++ = (b + area / 2) / area;
+		}
+	}
+}
+
+} // namespace nes
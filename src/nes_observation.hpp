@@ -0,0 +1,57 @@
+#ifndef __NES_OBSERVATION_HPP__
+#define __NES_OBSERVATION_HPP__
+
+#include <vector>
+
+namespace nes {
+
+class PaletteLUT;
+
+// Turns the indexed screen into a small grayscale or RGB observation in one
+// pass: crop, palette lookup, area-averaged resize and luminance conversion.
+class ObservationProcessor {
+
+    public:
+
+        ObservationProcessor();
+
+        /** Sets the output format. The source is cropped by the given number
+            of pixels on each side and averaged down to width x height.
+            Returns false (and keeps the old format) if the crop leaves less
+            than width x height pixels. */
+        bool configure(int src_width, int src_height, int width, int height, bool grayscale,
+                       int crop_top, int crop_bottom, int crop_left, int crop_right);
+
+        /** Returns the size in bytes of one observation. */
+        int getSize() const;
+
+        /** Rebuilds the lookup tables if the palette copy has changed. */
+        void updatePalette(const PaletteLUT &palette);
+
+        /** Converts an indexed screen of the configured source size into obs. */
+        void process(const unsigned char *screen, unsigned char *obs);
+
+    private:
+
+        void processGray(const unsigned char *screen, unsigned char *obs);
+        void processRGB(const unsigned char *screen, unsigned char *obs);
+
+        int m_src_width;
+        int m_width;
+        int m_height;
+        bool m_grayscale;
+        int m_crop_top;
+        int m_crop_left;
+        unsigned int m_palette_serial; // Serial of the palette the tables were built from
+
+        std::vector<int> m_col_start;   // First cropped column of each output column, plus an end marker
+        std::vector<int> m_row_start;   // First cropped row of each output row, plus an end marker
+        std::vector<unsigned int> m_acc; // Column sums of the rows feeding the current output row
+
+        unsigned int m_luma[256];       // Luminance of each palette entry
+        unsigned int m_rgb[256][3];     // Colour of each palette entry
+};
+
+} // namespace nes
+
+#endif // __NES_OBSERVATION_HPP__
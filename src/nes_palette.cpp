@@ -0,0 +1,112 @@
+#include "nes_palette.hpp"
+#include "nes_interface.hpp"
+#include "types.h"
+#include "driver.h"
+#include "palette.h"
+#include <string.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+namespace nes {
+
+PaletteLUT::PaletteLUT() :
+    m_serial(0)
+{
+	memset(m_rgba, 0, sizeof(m_rgba));
+	memset(m_bgra, 0, sizeof(m_bgra));
+}
+
+void PaletteLUT::update() {
+
+	if (m_serial == palette_serial) {
+		return;
+	}
+
+	for (int i = 0; i < 256; i++) {
+		unsigned char rgba[4], bgra[4];
+		FCEUD_GetPalette(i, &rgba[0], &rgba[1], &rgba[2]);
+		rgba[3] = 0xFF;
+		bgra[0] = rgba[2];
+		bgra[1] = rgba[1];
+		bgra[2] = rgba[0];
+		bgra[3] = 0xFF;
+		memcpy(&m_rgba[i], rgba, 4);
+		memcpy(&m_bgra[i], bgra, 4);
+	}
+	m_serial = palette_serial;
+}
+
+unsigned int PaletteLUT::getSerial() const {
+	return m_serial;
+}
+
+const unsigned char *PaletteLUT::getColor(int index) const {
+	return (const unsigned char *) &m_rgba[index];
+}
+
+int PaletteLUT::getBytesPerPixel(int format) {
+	return format == RGB_FORMAT_RGBA32 ? 4 : 3;
+}
+
+void PaletteLUT::convert(const unsigned char *src, unsigned char *dst, int num_pixels, int format) const {
+
+	switch (format) {
+
+		case RGB_FORMAT_RGBA32:
+			for (int i = 0; i < num_pixels; i++) {
+				memcpy(dst + 4 * i, &m_rgba[src[i]], 4);
+			}
+			break;
+
+		case RGB_FORMAT_BGR24:
+			convert24(m_bgra, src, dst, num_pixels);
+			break;
+
+		default:
+			convert24(m_rgba, src, dst, num_pixels);
+			break;
+	}
+}
+
+void PaletteLUT::convert24(const unsigned int *lut, const unsigned char *src, unsigned char *dst, int num_pixels) {
+
+	int i = 0;
+
+#ifdef __SSSE3__
+	// Gather 16 pixels into four vectors, drop the fourth byte of each
+	// with a shuffle and stitch the results into three 16 byte stores.
+	const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	for (; i + 16 <= num_pixels; i += 16) {
+		const unsigned char *s = src + i;
+		__m128i a = _mm_shuffle_epi8(_mm_setr_epi32(lut[s[0]], lut[s[1]], lut[s[2]], lut[s[3]]), pack);
+		__m128i b = _mm_shuffle_epi8(_mm_setr_epi32(lut[s[4]], lut[s[5]], lut[s[6]], lut[s[7]]), pack);
+		__m128i c = _mm_shuffle_epi8(_mm_setr_epi32(lut[s[8]], lut[s[9]], lut[s[10]], lut[s[11]]), pack);
+		__m128i d = _mm_shuffle_epi8(_mm_setr_epi32(lut[s[12]], lut[s[13]], lut[s[14]], lut[s[15]]), pack);
+		__m128i *out = (__m128i *) (dst + 3 * i);
+		_mm_storeu_si128(out, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+		_mm_storeu_si128(out + 1, _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+		_mm_storeu_si128(out + 2, _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+	}
+#endif
+
+#ifdef LSB_FIRST
+	// Pack four pixels into three words, so each pixel costs one table
+	// load instead of three byte copies.
+	for (; i + 4 <= num_pixels; i += 4) {
+		uint32 p0 = lut[src[i]], p1 = lut[src[i + 1]];
+		uint32 p2 = lut[src[i + 2]], p3 = lut[src[i + 3]];
+		uint32 w[3];
+		w[0] = (p0 & 0xFFFFFF) | (p1 << 24);
+		w[1] = ((p1 >> 8) & 0xFFFF) | (p2 << 16);
+		w[2] = ((p2 >> 16) & 0xFF) | (p3 << 8);
+		memcpy(dst + 3 * i, w, 12);
+	}
+#endif
+
+	for (; i < num_pixels; i++) {
+		memcpy(dst + 3 * i, &lut[src[i]], 3);
+	}
+}
+
+} // namespace nes
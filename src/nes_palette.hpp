@@ -0,0 +1,42 @@
+#ifndef __NES_PALETTE_HPP__
+#define __NES_PALETTE_HPP__
+
+namespace nes {
+
+// A copy of the driver palette packed for fast conversion of indexed
+// screens to colour. It is only re-read when the core changes the palette.
+class PaletteLUT {
+
+    public:
+
+        PaletteLUT();
+
+        /** Re-reads the palette if the core changed it since the last call. */
+        void update();
+
+        /** Returns the palette serial this copy was read at. */
+        unsigned int getSerial() const;
+
+        /** Returns the red, green and blue bytes of a palette entry. */
+        const unsigned char *getColor(int index) const;
+
+        /** Returns the bytes per pixel of an RGB_FORMAT_* layout. */
+        static int getBytesPerPixel(int format);
+
+        /** Converts num_pixels indexed pixels into the given RGB_FORMAT_*
+            layout. */
+        void convert(const unsigned char *src, unsigned char *dst, int num_pixels, int format) const;
+
+    private:
+
+        // Writes 3 bytes per pixel from one of the packed tables.
+        static void convert24(const unsigned int *lut, const unsigned char *src, unsigned char *dst, int num_pixels);
+
+        unsigned int m_serial;
+        unsigned int m_rgba[256]; // R, G, B, 255 in memory order
+        unsigned int m_bgra[256]; // B, G, R, 255 in memory order
+};
+
+} // namespace nes
+
+#endif // __NES_PALETTE_HPP__
@@ -0,0 +1,498 @@
+#include "nes_vector_env.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <algorithm>
+
+namespace nes {
+
+class NESVectorEnv::Impl {
+
+    public:
+
+        Impl(const std::string &rom_file, int num_envs, int num_workers);
+        ~Impl();
+
+        bool isReady() const;
+        int getNumEnvs() const;
+        int getScreenSize() const;
+        void resetAll();
+        bool act(const int *actions, int *rewards, bool *dones, unsigned char *screens);
+        void send(const int *env_ids, const int *actions, int count);
+        int recv(int *env_ids, int *rewards, bool *dones, unsigned char *screens, int max_count, int min_count);
+
+    private:
+
+        enum Command {
+            CMD_ACT,
+            CMD_RESET
+        };
+
+        // Start of the slab, shared by everyone.
+        struct Control {
+            sem_t sync_done;     // Posted when a command of act or resetAll finishes
+            sem_t async_done;    // Posted when a sent action finishes
+            unsigned int finish_count; // Numbers the sent actions as they finish
+            volatile int quit;
+        };
+
+        // Per environment part of the slab. The server fills in a command
+        // and sets queued; the worker clears it once the results are in.
+        struct Slot {
+            int command;
+            int action;
+            bool async;          // Sent by send; the results wait for recv
+            bool want_screen;
+            unsigned int order;  // A worker runs its oldest command first
+            volatile int queued;
+            int reward;          // Results of act
+            bool done;
+            int async_reward;    // Results of send, kept apart so act leaves them alone
+            bool async_done;
+            volatile unsigned int finished; // Finish number of a sent action, 0 once received
+        };
+
+        // Main loop of the worker processes. Never returns.
+        void workerMain(int worker);
+
+        // Runs the oldest command queued for one of the worker's environments.
+        void runCommand(int worker, std::vector<NESInterface *> &envs);
+
+        // Waits for a post on sem, checking now and then that no worker died.
+        bool waitFor(sem_t *sem);
+
+        // Returns false if a worker process has exited.
+        bool checkWorkers();
+
+        // Queues a command for an environment and wakes its worker.
+        void post(int env_id, Command command, int action, bool async, bool want_screen);
+
+        // Runs a command on every environment and waits for all of them,
+        // after the sent actions still running.
+        bool dispatch(Command command, const int *actions, bool want_screens);
+
+        std::string m_rom_file;
+        NESInterface *m_env;      // The environment the workers are forked from
+        int m_num_envs;
+        int m_num_workers;
+        int m_screen_size;
+        std::vector<pid_t> m_pids;
+        bool m_failed;            // No more steps are possible
+
+        // The slab and the pieces it is cut into.
+        unsigned char *m_slab;
+        size_t m_slab_size;
+        Control *m_control;
+        sem_t *m_starts;          // One per worker, posted once per queued command
+        Slot *m_slots;
+        unsigned char *m_screens;       // Screens of act
+        unsigned char *m_async_screens; // Screens of send
+
+        // Server side of send/recv.
+        unsigned int m_order;     // Last order handed out
+        std::vector<bool> m_sent; // Sent to and not received yet
+        int m_in_flight;          // Sent actions whose finish was not seen yet
+        int m_ready;              // Finished sent actions not received yet
+};
+
+// Rounds a slab offset up to a cache line.
+static size_t alignSlab(size_t offset) {
+	return (offset + 63) & ~(size_t) 63;
+}
+
+NESVectorEnv::Impl::Impl(const std::string &rom_file, int num_envs, int num_workers) :
+    m_rom_file(rom_file),
+    m_env(NULL),
+    m_num_envs(num_envs),
+    m_num_workers(num_workers),
+    m_screen_size(0),
+    m_failed(false),
+    m_slab(NULL),
+    m_slab_size(0),
+    m_control(NULL),
+    m_starts(NULL),
+    m_slots(NULL),
+    m_screens(NULL),
+    m_async_screens(NULL),
+    m_order(0),
+    m_in_flight(0),
+    m_ready(0)
+{
+	if (m_num_envs < 1) {
+		printf("ERROR: NESVectorEnv needs at least one environment.\n");
+		m_num_envs = 1;
+	}
+	if (m_num_workers < 1 || m_num_workers > m_num_envs) {
+		m_num_workers = m_num_envs;
+	}
+	m_sent.resize(m_num_envs, false);
+
+	// Load and boot once; the workers start from here.
+	m_env = new NESInterface(rom_file);
+	m_screen_size = m_env->getScreenWidth() * m_env->getScreenHeight();
+
+	size_t control_offset = 0;
+	size_t starts_offset = alignSlab(control_offset + sizeof(Control));
+	size_t slots_offset = alignSlab(starts_offset + m_num_workers * sizeof(sem_t));
+	size_t screens_offset = alignSlab(slots_offset + m_num_envs * sizeof(Slot));
+	size_t async_screens_offset = alignSlab(screens_offset + (size_t) m_num_envs * m_screen_size);
+	m_slab_size = async_screens_offset + (size_t) m_num_envs * m_screen_size;
+
+	void *slab = mmap(NULL, m_slab_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (slab == MAP_FAILED) {
+		printf("ERROR: Could not map %lu bytes of shared memory.\n", (unsigned long) m_slab_size);
+		m_slab_size = 0;
+		m_failed = true;
+		return;
+	}
+	m_slab = (unsigned char *) slab;
+	m_control = (Control *) (m_slab + control_offset);
+	m_starts = (sem_t *) (m_slab + starts_offset);
+	m_slots = (Slot *) (m_slab + slots_offset);
+	m_screens = m_slab + screens_offset;
+	m_async_screens = m_slab + async_screens_offset;
+
+	sem_init(&m_control->sync_done, 1, 0);
+	sem_init(&m_control->async_done, 1, 0);
+	for (int i = 0; i < m_num_workers; i++) {
+		sem_init(&m_starts[i], 1, 0);
+	}
+
+	// Anything still buffered would be printed again by every worker.
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t parent = getpid();
+	for (int i = 0; i < m_num_workers; i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			// Die with the server even if it never runs its destructor. If
+			// it is already gone, the signal will not come.
+			prctl(PR_SET_PDEATHSIG, SIGKILL);
+			if (getppid() != parent) {
+				_exit(0);
+			}
+			workerMain(i);
+		}
+		if (pid < 0) {
+			printf("ERROR: Could not fork NESVectorEnv worker %d.\n", i);
+			m_failed = true;
+			break;
+		}
+		m_pids.push_back(pid);
+	}
+}
+
+NESVectorEnv::Impl::~Impl() {
+
+	if (m_slab) {
+		m_control->quit = 1;
+		for (int i = 0; i < (int) m_pids.size(); i++) {
+			if (m_pids[i] > 0) {
+				sem_post(&m_starts[i]);
+			}
+		}
+	}
+	for (int i = 0; i < (int) m_pids.size(); i++) {
+		if (m_pids[i] > 0) {
+			waitpid(m_pids[i], NULL, 0);
+		}
+	}
+
+	if (m_slab) {
+		for (int i = 0; i < m_num_workers; i++) {
+			sem_destroy(&m_starts[i]);
+		}
+		sem_destroy(&m_control->async_done);
+		sem_destroy(&m_control->sync_done);
+		munmap(m_slab, m_slab_size);
+	}
+	delete m_env;
+}
+
+void NESVectorEnv::Impl::workerMain(int worker) {
+
+	// Worker w runs environments w, w + num_workers, ... The first one is
+	// the copy of the server's environment, the others join its core.
+	std::vector<NESInterface *> envs;
+	for (int id = worker; id < m_num_envs; id += m_num_workers) {
+		NESInterface *env = envs.empty() ? m_env : new NESInterface(m_rom_file);
+		env->setSeed(id + 1);
+		envs.push_back(env);
+	}
+
+	for (;;) {
+		while (sem_wait(&m_starts[worker]) != 0 && errno == EINTR) {
+		}
+		if (m_control->quit) {
+			// Skip destructors; they belong to the server process.
+			_exit(0);
+		}
+		runCommand(worker, envs);
+	}
+}
+
+void NESVectorEnv::Impl::runCommand(int worker, std::vector<NESInterface *> &envs) {
+
+	int id = -1;
+	for (int i = worker; i < m_num_envs; i += m_num_workers) {
+		if (m_slots[i].queued && (id < 0 || (int) (m_slots[i].order - m_slots[id].order) < 0)) {
+			id = i;
+		}
+	}
+	if (id < 0) {
+		return;
+	}
+
+	Slot *slot = &m_slots[id];
+	NESInterface *env = envs[id / m_num_workers];
+	unsigned char *screen = NULL;
+	if (slot->want_screen) {
+		screen = (slot->async ? m_async_screens : m_screens) + (size_t) id * m_screen_size;
+	}
+
+	int reward = 0;
+	bool done = false;
+	if (slot->command == CMD_RESET) {
+		env->resetGame();
+	} else {
+		reward = env->step(slot->action, &done, screen, m_screen_size);
+	}
+
+	if (slot->async) {
+		slot->async_reward = reward;
+		slot->async_done = done;
+		__sync_synchronize();
+		// 0 means received, so skip it when the count wraps.
+		unsigned int finished;
+		do {
+			finished = __sync_add_and_fetch(&m_control->finish_count, 1);
+		} while (finished == 0);
+		slot->finished = finished;
+		slot->queued = 0;
+		sem_post(&m_control->async_done);
+	} else {
+		slot->reward = reward;
+		slot->done = done;
+		slot->queued = 0;
+		sem_post(&m_control->sync_done);
+	}
+}
+
+bool NESVectorEnv::Impl::checkWorkers() {
+
+	bool alive = true;
+	for (int i = 0; i < (int) m_pids.size(); i++) {
+		if (m_pids[i] > 0 && waitpid(m_pids[i], NULL, WNOHANG) == m_pids[i]) {
+			printf("ERROR: NESVectorEnv worker %d exited.\n", i);
+			m_pids[i] = -1;
+			alive = false;
+		}
+	}
+	return alive;
+}
+
+bool NESVectorEnv::Impl::waitFor(sem_t *sem) {
+
+	for (;;) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += 1;
+		if (sem_timedwait(sem, &deadline) == 0) {
+			return true;
+		}
+		if (errno == ETIMEDOUT && !checkWorkers()) {
+			m_failed = true;
+			return false;
+		}
+	}
+}
+
+void NESVectorEnv::Impl::post(int env_id, Command command, int action, bool async, bool want_screen) {
+
+	Slot *slot = &m_slots[env_id];
+	slot->command = command;
+	slot->action = action;
+	slot->async = async;
+	slot->want_screen = want_screen;
+	slot->order = ++m_order;
+	slot->queued = 1;
+	sem_post(&m_starts[env_id % m_num_workers]);
+}
+
+bool NESVectorEnv::Impl::dispatch(Command command, const int *actions, bool want_screens) {
+
+	if (m_failed) {
+		return false;
+	}
+
+	// Let sent actions finish first; their results stay receivable.
+	while (m_in_flight > 0) {
+		if (!waitFor(&m_control->async_done)) {
+			return false;
+		}
+		m_in_flight--;
+		m_ready++;
+	}
+
+	for (int i = 0; i < m_num_envs; i++) {
+		post(i, command, actions ? actions[i] : ACT_NOOP, false, want_screens);
+	}
+	for (int i = 0; i < m_num_envs; i++) {
+		if (!waitFor(&m_control->sync_done)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void NESVectorEnv::Impl::send(const int *env_ids, const int *actions, int count) {
+
+	if (m_failed) {
+		printf("ERROR: NESVectorEnv has lost a worker; nothing was sent.\n");
+		return;
+	}
+	for (int i = 0; i < count; i++) {
+		int id = env_ids[i];
+		if (id < 0 || id >= m_num_envs) {
+			printf("ERROR: NESVectorEnv has no environment %d.\n", id);
+			continue;
+		}
+		if (m_sent[id]) {
+			printf("ERROR: Environment %d has a result that was not received yet.\n", id);
+			continue;
+		}
+		m_sent[id] = true;
+		m_in_flight++;
+		post(id, CMD_ACT, actions[i], true, true);
+	}
+}
+
+int NESVectorEnv::Impl::recv(int *env_ids, int *rewards, bool *dones, unsigned char *screens, int max_count, int min_count) {
+
+	if (min_count > max_count) {
+		min_count = max_count;
+	}
+
+	// Take whatever has finished, then wait for the rest of min_count.
+	// Stop early if nothing more can arrive.
+	while (m_in_flight > 0 && sem_trywait(&m_control->async_done) == 0) {
+		m_in_flight--;
+		m_ready++;
+	}
+	while (m_ready < min_count && m_in_flight > 0 && !m_failed) {
+		if (!waitFor(&m_control->async_done)) {
+			break;
+		}
+		m_in_flight--;
+		m_ready++;
+	}
+
+	// Every finish seen belongs to one of these; hand out the oldest.
+	std::vector<std::pair<unsigned int, int> > finished;
+	for (int id = 0; id < m_num_envs; id++) {
+		if (m_sent[id] && m_slots[id].finished) {
+			finished.push_back(std::make_pair(m_slots[id].finished - 1, id));
+		}
+	}
+	std::sort(finished.begin(), finished.end());
+	__sync_synchronize();
+
+	int count = std::min(std::min(max_count, m_ready), (int) finished.size());
+	for (int i = 0; i < count; i++) {
+		int id = finished[i].second;
+		Slot *slot = &m_slots[id];
+		env_ids[i] = id;
+		rewards[i] = slot->async_reward;
+		dones[i] = slot->async_done;
+		if (screens) {
+			memcpy(screens + (size_t) i * m_screen_size,
+			       m_async_screens + (size_t) id * m_screen_size, m_screen_size);
+		}
+		slot->finished = 0;
+		m_sent[id] = false;
+	}
+	m_ready -= count;
+	return count;
+}
+
+bool NESVectorEnv::Impl::isReady() const {
+	return !m_failed;
+}
+
+int NESVectorEnv::Impl::getNumEnvs() const {
+	return m_num_envs;
+}
+
+int NESVectorEnv::Impl::getScreenSize() const {
+	return m_screen_size;
+}
+
+void NESVectorEnv::Impl::resetAll() {
+	dispatch(CMD_RESET, NULL, false);
+}
+
+bool NESVectorEnv::Impl::act(const int *actions, int *rewards, bool *dones, unsigned char *screens) {
+
+	if (!dispatch(CMD_ACT, actions, screens != NULL)) {
+		return false;
+	}
+	for (int i = 0; i < m_num_envs; i++) {
+		rewards[i] = m_slots[i].reward;
+		dones[i] = m_slots[i].done;
+	}
+	if (screens) {
+		memcpy(screens, m_screens, (size_t) m_num_envs * m_screen_size);
+	}
+	return true;
+}
+
+/* --------------------------------------------------------------------------------------------------*/
+
+/* begin PIMPL wrapper */
+
+bool NESVectorEnv::isReady() const {
+    return m_pimpl->isReady();
+}
+
+int NESVectorEnv::getNumEnvs() const {
+    return m_pimpl->getNumEnvs();
+}
+
+int NESVectorEnv::getScreenSize() const {
+    return m_pimpl->getScreenSize();
+}
+
+void NESVectorEnv::resetAll() {
+    m_pimpl->resetAll();
+}
+
+bool NESVectorEnv::act(const int *actions, int *rewards, bool *dones, unsigned char *screens) {
+    return m_pimpl->act(actions, rewards, dones, screens);
+}
+
+void NESVectorEnv::send(const int *env_ids, const int *actions, int count) {
+    m_pimpl->send(env_ids, actions, count);
+}
+
+int NESVectorEnv::recv(int *env_ids, int *rewards, bool *dones, unsigned char *screens, int max_count, int min_count) {
+    return m_pimpl->recv(env_ids, rewards, dones, screens, max_count, min_count);
+}
+
+NESVectorEnv::NESVectorEnv(const std::string &rom_file, int num_envs, int num_workers) :
+    m_pimpl(new NESVectorEnv::Impl(rom_file, num_envs, num_workers)) {
+
+}
+
+NESVectorEnv::~NESVectorEnv() {
+    delete m_pimpl;
+}
+
+} // namespace nes
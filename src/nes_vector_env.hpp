@@ -0,0 +1,79 @@
+#ifndef __NES_VECTOR_ENV_HPP__
+#define __NES_VECTOR_ENV_HPP__
+
+#include "nes_interface.hpp"
+
+namespace nes {
+
+// This class steps a batch of NESInterface environments with one call. The
+// environments run in worker processes forked once the ROM is loaded, so
+// they step in parallel; results are copied out of shared memory into the
+// caller's arrays.
+class NESVectorEnv {
+
+    public:
+
+        /** create num_envs environments running rom_file, spread over
+            num_workers worker processes (one per environment if 0).
+            Environments that share a worker step one after the other and
+            swap their machine state on every switch, so fewer workers save
+            memory at the cost of speed. Environment i is seeded with i + 1
+            (see NESInterface::setSeed). Create it before other threads
+            start using NESInterface, as only the calling thread survives
+            the fork. */
+        NESVectorEnv(const std::string &rom_file, int num_envs, int num_workers = 0);
+
+        /** Stop the worker processes. */
+        ~NESVectorEnv();
+
+        /** Returns false if the shared memory could not be mapped, not
+            every worker could be started or a worker has died. No steps
+            are possible then. */
+        bool isReady() const;
+
+        /** Returns the number of environments. */
+        int getNumEnvs() const;
+
+        /** Returns the size in bytes of one environment's screen. */
+        int getScreenSize() const;
+
+        /** Resets every environment. */
+        void resetAll();
+
+        /** Applies actions[i] to environment i. rewards and dones must hold
+            getNumEnvs() entries each. If screens is not NULL it must hold
+            getNumEnvs() * getScreenSize() bytes and receives the raw screens
+            one after the other. Returns false, leaving the arrays alone, if
+            a worker process has died. As with NESInterface::act it is the
+            user's responsibility to reset environments that are done. */
+        bool act(const int *actions, int *rewards, bool *dones, unsigned char *screens);
+
+        /** Starts applying actions[i] to environment env_ids[i] in the
+            background and returns at once. ACT_RESET resets the environment
+            instead. An environment can only be sent to again once its
+            result has been received. act and resetAll wait for sent actions
+            to finish, but leave their results to recv. */
+        void send(const int *env_ids, const int *actions, int count);
+
+        /** Collects the results of sent actions in the order they finished,
+            blocking until at least min_count (at most max_count) are ready
+            or nothing more is outstanding. Fills env_ids, rewards, dones
+            and, if not NULL, screens (one getScreenSize() block per result)
+            and returns how many results were written. */
+        int recv(int *env_ids, int *rewards, bool *dones, unsigned char *screens, int max_count, int min_count = 1);
+
+    private:
+
+        /** Copying is explicitly disallowed. */
+        NESVectorEnv(const NESVectorEnv &);
+
+        /** Assignment is explicitly disallowed. */
+        NESVectorEnv &operator=(const NESVectorEnv &);
+
+        class Impl;
+        Impl *m_pimpl;
+};
+
+} // namespace nes
+
+#endif // __NES_VECTOR_ENV_HPP__
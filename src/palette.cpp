@@ -42,6 +42,10 @@
 
 bool force_grayscale = false;
 
+//bumped whenever entries are handed to FCEUD_SetPalette, so code that caches
+//the driver palette knows when to read it again
+uint32 palette_serial = 1;
+
 pal palette_game[64*8]; //custom palette for an individual game. (formerly palettei)
 pal palette_user[64*8]; //user's overridden palette (formerly palettec)
 pal palette_ntsc[64*8]; //mathematically generated NTSC palette (formerly paletten)
@@ -405,6 +409,7 @@ void SetNESDeemph_OldHacky(uint8 d, int force)
 			if(o>0xff) o=0xff;
 			FCEUD_SetPalette(x|0xC0,m,n,o);
 		}
+		palette_serial++;
 	}
 	if(!d) return; /* No deemphasis, so return. */
 
@@ -428,6 +433,7 @@ void SetNESDeemph_OldHacky(uint8 d, int force)
 
 		FCEUD_SetPalette(x|0x40,m,n,o);
 	}
+	palette_serial++;
 
 	lastd=d;
 	#ifdef _S9XLUA_H
@@ -3,6 +3,7 @@ typedef struct {
 } pal;
 
 extern pal *palo;
+extern uint32 palette_serial;
 void FCEU_ResetPalette(void);
 
 void FCEU_ResetPalette(void);
@@ -65,6 +65,10 @@ static void RefreshSprites(void);
 static void CopySprites(uint8 *target);
 
 static void Fixit1(void);
+static void FlushLazyLines(void);
+static void GoLive(void);
+static int lazyframe = 0;	//This frame logs lines instead of drawing them
+static int lazypending = 0;	//The current line has not been drawn yet
 static uint32 ppulut1[256];
 static uint32 ppulut2[256];
 static uint32 ppulut3[128];
@@ -509,7 +513,10 @@ static DECLFR(A2002) {
 
 	uint8 ret;
 
-	FCEUPPU_LineUpdate();
+	//Reads draw the line for the sprite 0 hit check, which a line that is
+	//only logged cannot have.
+	if (!lazypending)
+		FCEUPPU_LineUpdate();
 	ret = PPU_status;
 	ret |= PPUGenLatch & 0x1F;
 
@@ -650,13 +657,15 @@ static DECLFR(A2004) {
 		} else
 			return SPRAM[PPU[3]];
 	} else {
-		FCEUPPU_LineUpdate();
+		if (!lazypending)
+			FCEUPPU_LineUpdate();
 		return PPUGenLatch;
 	}
 }
 
 static DECLFR(A200x) {	/* Not correct for $2004 reads. */
-	FCEUPPU_LineUpdate();
+	if (!lazypending)
+		FCEUPPU_LineUpdate();
 	return PPUGenLatch;
 }
 
@@ -893,6 +902,8 @@ static DECLFW(B2007) {
 		ppur.increment2007(ppur.status.sl >= 0 && ppur.status.sl < 241 && PPUON, INC32 != 0);
 		RefreshAddr = ppur.get_2007access();
 	} else {
+		//Logged lines must be drawn from the memory they were logged with.
+		FlushLazyLines();
 		PPUGenLatch = V;
 		if (tmp < 0x2000) {
 			if (PPUCHRRAM & (1 << (tmp >> 10)))
@@ -959,6 +970,8 @@ void FCEUPPU_LineUpdate(void) {
 #endif
 	if (Pline) {
 		int l = GETLASTPIXEL;
+		if (lazypending)
+			GoLive();
 		RefreshLine(l);
 	}
 }
@@ -1007,10 +1020,11 @@ static void CheckSpriteHit(int p) {
 //Needed for zapper emulation and *gasp* sprite emulation.
 static int spork = 0;
 
+static uint32 pshift[2];
+static uint32 atlatch;
+
 // lasttile is really "second to last tile."
 static void RefreshLine(int lastpixel) {
-	static uint32 pshift[2];
-	static uint32 atlatch;
 	uint32 smorkus = RefreshAddr;
 
 	#define RefreshAddr smorkus
@@ -1221,19 +1235,14 @@ static void Fixit1(void) {
 	}
 }
 
-void MMC5_hb(int);		//Ugh ugh ugh.
-static void DoLine(void) {
-	int x;
-	// scanlines after 239 are dummy for dendy, and Xbuf is capped at 0xffff bytes, don't let it overflow
-	// send all future writes to the invisible sanline. the easiest way to "skip" them altogether in old ppu
-	// todo: figure out what exactly should be skipped. it's known that there's no activity on PPU bus
-	uint8 *target = XBuf + ((scanline < 240 ? scanline : 240) << 8);
-	u8* dtarget = XDBuf + ((scanline < 240 ? scanline : 240) << 8);
-
-	if (MMC5Hack) MMC5_hb(scanline);
+static void EndLazyRL(void);
+static void ResetLazyRL(uint8 *target);
+static void RefreshLazySprites(void);
+static void LoadLazySprites(void);
 
-	X6502_Run(256);
-	EndRL();
+//Everything DoLine does to a line's pixels after the background.
+static void FinishLine(uint8 *target, u8 *dtarget) {
+	int x;
 
 	if (!renderbg) {// User asked to not display background data.
 		uint32 tem;
@@ -1272,6 +1281,28 @@ static void DoLine(void) {
 	//write the actual deemph
 	for (x = 63; x >= 0; x--)
 		*(uint32*)&dtarget[x << 2] = ((PPU[1]>>5)<<0)|((PPU[1]>>5)<<8)|((PPU[1]>>5)<<16)|((PPU[1]>>5)<<24);
+}
+
+void MMC5_hb(int);		//Ugh ugh ugh.
+static void DoLine(void) {
+	// scanlines after 239 are dummy for dendy, and Xbuf is capped at 0xffff bytes, don't let it overflow
+	// send all future writes to the invisible sanline. the easiest way to "skip" them altogether in old ppu
+	// todo: figure out what exactly should be skipped. it's known that there's no activity on PPU bus
+	uint8 *target = XBuf + ((scanline < 240 ? scanline : 240) << 8);
+	u8* dtarget = XDBuf + ((scanline < 240 ? scanline : 240) << 8);
+
+	if (MMC5Hack) MMC5_hb(scanline);
+
+	X6502_Run(256);
+	if (lazypending)
+		EndLazyRL();
+	else {
+		EndRL();
+		//Lines below the screen are not logged, just drawn.
+		if (lazyframe && scanline >= 240)
+			LoadLazySprites();
+		FinishLine(target, dtarget);
+	}
 
 	sphitx = 0x100;
 
@@ -1296,13 +1327,20 @@ static void DoLine(void) {
 
 	DEBUG(FCEUD_UpdateNTView(scanline, 0));
 
-	if (SpriteON)
-		RefreshSprites();
+	if (SpriteON) {
+		if (lazyframe)
+			RefreshLazySprites();
+		else
+			RefreshSprites();
+	}
 	if (GameHBIRQHook2 && (ScreenON || SpriteON))
 		GameHBIRQHook2();
 	scanline++;
 	if (scanline < 240) {
-		ResetRL(XBuf + (scanline << 8));
+		if (lazyframe)
+			ResetLazyRL(XBuf + (scanline << 8));
+		else
+			ResetRL(XBuf + (scanline << 8));
 	}
 	X6502_Run(16);
 }
@@ -1324,6 +1362,17 @@ void FCEUI_DisableSpriteLimitation(int a) {
 }
 
 static uint8 numsprites, SpriteBlurp;
+
+//Sprites found on each screen line of the last rendered frame, as OAM indices.
+//Row 240 catches the lines below the screen.
+uint8 FCEUPPU_LineSpriteCount[241];
+uint8 FCEUPPU_LineSprites[241][8];
+int FCEUPPU_FrameScrollX, FCEUPPU_FrameScrollY;
+
+void FCEUPPU_ClearLineSprites(void) {
+	memset(FCEUPPU_LineSpriteCount, 0, sizeof(FCEUPPU_LineSpriteCount));
+}
+
 static void FetchSpriteData(void) {
 	uint8 ns, sb;
 	SPR *spr;
@@ -1331,6 +1380,8 @@ static void FetchSpriteData(void) {
 	int n;
 	int vofs;
 	uint8 P0 = PPU[0];
+	//Sprites found now are drawn on the next line.
+	uint8 *line = FCEUPPU_LineSprites[scanline < 239 ? scanline + 1 : 240];
 
 	spr = (SPR*)SPRAM;
 	H = 8;
@@ -1387,6 +1438,7 @@ static void FetchSpriteData(void) {
 					*(uint32*)&SPRBUF[ns << 2] = *(uint32*)&dst;
 				}
 
+				if (ns < 8) line[ns] = 63 - n;
 				ns++;
 			} else {
 				PPU_status |= 0x20;
@@ -1444,6 +1496,7 @@ static void FetchSpriteData(void) {
 					*(uint32*)&SPRBUF[ns << 2] = *(uint32*)&dst;
 				}
 
+				if (ns < 8) line[ns] = 63 - n;
 				ns++;
 			} else {
 				PPU_status |= 0x20;
@@ -1459,10 +1512,30 @@ static void FetchSpriteData(void) {
 			PPU_hook(vofs);
 		}
 	}
+	FCEUPPU_LineSpriteCount[scanline < 239 ? scanline + 1 : 240] = ns;
 	numsprites = ns;
 	SpriteBlurp = sb;
 }
 
+//Arms the sprite 0 hit check if spr, the first sprite on the coming line, is sprite 0.
+static void SetupSprite0Hit(SPRB *spr) {
+	uint8 J = spr->ca[0] | spr->ca[1];
+
+	if (J && SpriteBlurp && !(PPU_status & 0x40)) {
+		sphitx = spr->x;
+		sphitdata = J;
+		if (spr->atr & H_FLIP)
+			sphitdata = ((J << 7) & 0x80) |
+						((J << 5) & 0x40) |
+						((J << 3) & 0x20) |
+						((J << 1) & 0x10) |
+						((J >> 1) & 0x08) |
+						((J >> 3) & 0x04) |
+						((J >> 5) & 0x02) |
+						((J >> 7) & 0x01);
+	}
+}
+
 static void RefreshSprites(void) {
 	int n;
 	SPRB *spr;
@@ -1487,19 +1560,8 @@ static void RefreshSprites(void) {
 		atr = spr->atr;
 
 		if (J) {
-			if (n == 0 && SpriteBlurp && !(PPU_status & 0x40)) {
-				sphitx = x;
-				sphitdata = J;
-				if (atr & H_FLIP)
-					sphitdata = ((J << 7) & 0x80) |
-								((J << 5) & 0x40) |
-								((J << 3) & 0x20) |
-								((J << 1) & 0x10) |
-								((J >> 1) & 0x08) |
-								((J >> 3) & 0x04) |
-								((J >> 5) & 0x02) |
-								((J >> 7) & 0x01);
-			}
+			if (n == 0)
+				SetupSprite0Hit(spr);
 
 			C = sprlinebuf + x;
 			VB = (PALRAM + 0x10) + ((atr & 3) << 2);
@@ -1649,6 +1711,226 @@ static void CopySprites(uint8 *target) {
 	if (n) goto loopskie;
 }
 
+//Lazy rendering.  Instead of drawing a line, DoLine logs the state the line
+//would have been drawn with, and FCEUPPU_DrawLazyFrame draws the logged lines
+//when the screen is wanted.  A line is drawn the usual way as soon as the CPU
+//touches the PPU during it or a sprite 0 hit can happen on it, so nothing the
+//CPU can see changes.  Mappers that watch the PPU's fetches are not supported.
+
+typedef struct {
+	uint8 *vpage[8], *vnapage[4];
+	uint32 refreshaddr;
+	uint8 xoffset, ppu0, ppu1;
+	uint8 logged;	//Not drawn yet
+	int sprites;	//lazysprites entry CopySprites would draw, or -1
+	uint8 pal[0x20];
+} LAZYLINE;
+
+typedef struct {
+	uint8 num;
+	uint8 pal[0x10];
+	uint8 buf[0x100];
+} LAZYSPRITES;
+
+static int lazyrendering = 0;
+static int lazylogged = 0;	//Some lines of the frame are only logged
+static int lazystale = 0;	//XBackBuf misses the last frame
+static int lazysprite = -1;	//lazysprites entry sprlinebuf stands for
+static LAZYLINE lazylines[240];
+static LAZYSPRITES lazysprites[241];
+
+void FCEUPPU_SetLazyRendering(int lazy) {
+	lazyrendering = lazy;
+}
+
+//Fills sprlinebuf from a logged sprite line, as RefreshSprites did not.
+static void DrawLazySprites(LAZYSPRITES *s) {
+	uint8 buf[0x100], pal[0x10];
+	uint8 num = numsprites, blurp = SpriteBlurp;
+
+	memcpy(buf, SPRBUF, s->num << 2);
+	memcpy(pal, PALRAM + 0x10, 0x10);
+	memcpy(SPRBUF, s->buf, s->num << 2);
+	memcpy(PALRAM + 0x10, s->pal, 0x10);
+	numsprites = s->num;
+	SpriteBlurp = 0;	//The hit check was armed when the sprites were logged.
+	RefreshSprites();
+	memcpy(SPRBUF, buf, s->num << 2);
+	memcpy(PALRAM + 0x10, pal, 0x10);
+	numsprites = num;
+	SpriteBlurp = blurp;
+}
+
+//Gives sprlinebuf what RefreshSprites would have left in it.
+static void LoadLazySprites(void) {
+	if (spork)
+		DrawLazySprites(&lazysprites[lazysprite]);
+}
+
+//RefreshSprites for lazy frames: arms the sprite 0 hit check and logs the sprites.
+static void RefreshLazySprites(void) {
+	int n = scanline < 240 ? scanline : 240;
+	LAZYSPRITES *s = &lazysprites[n];
+
+	spork = 0;
+	if (!numsprites) return;
+
+	SetupSprite0Hit((SPRB*)SPRBUF);
+	s->num = numsprites;
+	memcpy(s->buf, SPRBUF, numsprites << 2);
+	memcpy(s->pal, PALRAM + 0x10, 0x10);
+	lazysprite = n;
+
+	numsprites--;
+	SpriteBlurp = 0;
+	spork = 1;
+}
+
+//ResetRL for lazy frames.
+static void ResetLazyRL(uint8 *target) {
+	if (sphitx != 0x100) {
+		//The hit check needs the background.
+		ResetRL(target);
+		LoadLazySprites();
+		return;
+	}
+
+	InputScanlineHook(0, 0, 0, 0);
+	Plinef = target;
+	Pline = target;
+	firsttile = 0;
+	linestartts = timestamp * 48 + X.count;
+	tofix = 1;
+	lazypending = 1;
+}
+
+//Switches the current line to drawing, before the CPU changes the PPU mid-line.
+static void GoLive(void) {
+	lazypending = 0;
+	memset(Plinef, 0xFF, 256);
+	LoadLazySprites();
+}
+
+//EndRL and FinishLine for a line nobody has drawn: log it.
+static void EndLazyRL(void) {
+	LAZYLINE *l = &lazylines[scanline];
+	int x;
+
+	for (x = 0; x < 8; x++)
+		l->vpage[x] = VPage[x];
+	for (x = 0; x < 4; x++)
+		l->vnapage[x] = vnapage[x];
+	l->refreshaddr = RefreshAddr;
+	l->xoffset = XOffset;
+	l->ppu0 = PPU[0];
+	l->ppu1 = PPU[1];
+	memcpy(l->pal, PALRAM, 0x20);
+	l->sprites = -1;
+	if (SpriteON) {
+		if (spork)
+			l->sprites = lazysprite;
+		spork = 0;
+	}
+	l->logged = 1;
+	lazylogged = 1;
+	lazypending = 0;
+
+	if (tofix)
+		Fixit1();
+	Pline = 0;
+}
+
+//Exchanges the PPU state a line was logged with and the current one.
+static void SwapLazyState(LAZYLINE *l) {
+	uint8 pal[0x20];
+	uint8 *p;
+	uint32 a;
+	uint8 b;
+	int x;
+
+	for (x = 0; x < 8; x++) {
+		p = VPage[x]; VPage[x] = l->vpage[x]; l->vpage[x] = p;
+	}
+	for (x = 0; x < 4; x++) {
+		p = vnapage[x]; vnapage[x] = l->vnapage[x]; l->vnapage[x] = p;
+	}
+	a = RefreshAddr; RefreshAddr = l->refreshaddr; l->refreshaddr = a;
+	b = XOffset; XOffset = l->xoffset; l->xoffset = b;
+	b = PPU[0]; PPU[0] = l->ppu0; l->ppu0 = b;
+	b = PPU[1]; PPU[1] = l->ppu1; l->ppu1 = b;
+	memcpy(pal, PALRAM, 0x20);
+	memcpy(PALRAM, l->pal, 0x20);
+	memcpy(l->pal, pal, 0x20);
+}
+
+static void DrawLazyLine(int line) {
+	LAZYLINE *l = &lazylines[line];
+	uint8 *target = XBuf + (line << 8);
+
+	SwapLazyState(l);
+	memset(target, 0xFF, 256);
+	Plinef = Pline = target;
+	firsttile = 0;
+	tofix = 1;
+	sphitx = 0x100;
+	RefreshLine(272);
+	spork = 0;
+	if (l->sprites >= 0)
+		DrawLazySprites(&lazysprites[l->sprites]);
+	FinishLine(target, XDBuf + (line << 8));
+	SwapLazyState(l);
+	l->logged = 0;
+}
+
+//Draws the lines logged so far, leaving the PPU as it was.
+static void FlushLazyLines(void) {
+	uint8 linebuf[sizeof(sprlinebuf)];
+	uint8 *pline = Pline, *plinef = Plinef;
+	int first = firsttile, fix = tofix, spr = spork;
+	int32 hitx = sphitx;
+	uint32 shift0 = pshift[0], shift1 = pshift[1], latch = atlatch;
+	int x;
+
+	if (!lazylogged) return;
+	lazylogged = 0;
+
+	memcpy(linebuf, sprlinebuf, sizeof(sprlinebuf));
+	for (x = 0; x < 240; x++)
+		if (lazylines[x].logged)
+			DrawLazyLine(x);
+	memcpy(sprlinebuf, linebuf, sizeof(sprlinebuf));
+
+	Pline = pline;
+	Plinef = plinef;
+	firsttile = first;
+	tofix = fix;
+	spork = spr;
+	sphitx = hitx;
+	pshift[0] = shift0;
+	pshift[1] = shift1;
+	atlatch = latch;
+}
+
+static void DiscardLazyLines(void) {
+	int x;
+
+	if (lazylogged)
+		for (x = 0; x < 240; x++)
+			lazylines[x].logged = 0;
+	lazylogged = 0;
+	lazystale = 0;
+	lazysprite = -1;
+	lazypending = 0;
+}
+
+void FCEUPPU_DrawLazyFrame(void) {
+	FlushLazyLines();
+	if (lazystale) {
+		memcpy(XBackBuf, XBuf, 256 * 256);
+		lazystale = 0;
+	}
+}
+
 void FCEUPPU_SetVideoSystem(int w) {
 	if (w) {
 		scanlines_per_frame = dendy ? 262: 312;
@@ -1711,10 +1993,14 @@ void FCEUPPU_Power(void) {
 		ARead[x + 7] = A2007;
 		BWrite[x + 7] = B2007;
 	}
+	UpdateReadPages(0x2000, 0x3FFF);
 	BWrite[0x4014] = B4014;
 }
 
 int FCEUPPU_Loop(int skip) {
+	//Nobody looked at the last frame; it is about to be replaced.
+	DiscardLazyLines();
+
 	if ((newppu) && (GameInfo->type != GIT_NSF)) {
 		int FCEUX_PPU_Loop(int skip);
 		return FCEUX_PPU_Loop(skip);
@@ -1726,6 +2012,8 @@ int FCEUPPU_Loop(int skip) {
 		X6502_Run(scanlines_per_frame * (256 + 85));
 		ppudead--;
 	} else {
+		lazyframe = lazyrendering && !PPU_hook && !MMC5Hack && !PEC586Hack && GameInfo->type != GIT_NSF;
+
 		X6502_Run(256 + 85);
 		PPU_status |= 0x80;
 
@@ -1764,10 +2052,14 @@ int FCEUPPU_Loop(int skip) {
 				RefreshAddr = TempAddr;
 				if (PPU_hook) PPU_hook(RefreshAddr & 0x3fff);
 			}
+			ppu_getScroll(FCEUPPU_FrameScrollX, FCEUPPU_FrameScrollY);
 
 			//Clean this stuff up later.
 			spork = numsprites = 0;
-			ResetRL(XBuf);
+			if (lazyframe)
+				ResetLazyRL(XBuf);
+			else
+				ResetRL(XBuf);
 
 			X6502_Run(16 - kook);
 			kook ^= 1;
@@ -1775,7 +2067,7 @@ int FCEUPPU_Loop(int skip) {
 		if (GameInfo->type == GIT_NSF)
 			X6502_Run((256 + 85) * normalscanlines);
 		#ifdef FRAMESKIP
-		else if (skip) {
+		else if (skip && !lazyframe) {
 			int y;
 
 			y = SPRAM[0];
@@ -1807,6 +2099,7 @@ int FCEUPPU_Loop(int skip) {
 			else
 				totalscanlines = normalscanlines + (overclocked ? extrascanlines : 0);
 
+			FCEUPPU_ClearLineSprites();
 			for (scanline = 0; scanline < totalscanlines; ) {	//scanline is incremented in  DoLine.  Evil. :/
 				deempcnt[deemp]++;
 				if (scanline < normalscanlines)
@@ -1830,6 +2123,16 @@ int FCEUPPU_Loop(int skip) {
 		}
 	}	//else... to if(ppudead)
 
+	if (lazyframe) {
+		//FCEUPPU_DrawLazyFrame finishes the image when it is wanted.
+		lazyframe = 0;
+		lazystale = 1;
+	#ifdef FRAMESKIP
+		FCEU_PutImageDummy();
+	#endif
+		return(0);
+	}
+
 	#ifdef FRAMESKIP
 	if (skip) {
 		FCEU_PutImageDummy();
@@ -1847,6 +2150,7 @@ int (*PPU_MASTER)(int skip) = FCEUPPU_Loop;
 static uint16 TempAddrT, RefreshAddrT;
 
 void FCEUPPU_LoadState(int version) {
+	DiscardLazyLines();
 	TempAddr = TempAddrT;
 	RefreshAddr = RefreshAddrT;
 }
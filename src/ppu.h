@@ -23,6 +23,19 @@ uint32 FCEUPPU_PeekAddress();
 uint8* FCEUPPU_GetCHR(uint32 vadr, uint32 refreshaddr);
 void ppu_getScroll(int &xpos, int &ypos);
 
+/* Sprites the old PPU found on each screen line of the last rendered frame
+   (OAM indices, the first 8 per line) and the scroll it started with. */
+extern uint8 FCEUPPU_LineSpriteCount[241];
+extern uint8 FCEUPPU_LineSprites[241][8];
+extern int FCEUPPU_FrameScrollX, FCEUPPU_FrameScrollY;
+void FCEUPPU_ClearLineSprites(void);
+
+/* Lazy rendering: the old PPU logs each line instead of drawing it, and
+   FCEUPPU_DrawLazyFrame draws the last frame from the log when it is needed.
+   Emulation is the same as with drawing; skipped frames are emulated exactly too. */
+void FCEUPPU_SetLazyRendering(int lazy);
+void FCEUPPU_DrawLazyFrame(void);
+
 
 #ifdef _MSC_VER
 #define FASTCALL __fastcall
@@ -74,6 +74,11 @@ static uint8 fcnt=0;
 static int32 fhcnt=0;
 static int32 fhinc=0;
 
+//The CPU only calls FCEU_SoundCPUHook once SoundCPUCycles reaches
+//SoundCPUNext, the cycles until the frame counter or the DMC next needs it.
+int32 SoundCPUCycles=0;
+int32 SoundCPUNext=0;
+
 uint32 soundtsoffs=0;
 
 /* Variables exclusively for low-quality sound. */
@@ -306,8 +311,17 @@ static DECLFW(Write_PSG)
 	PSG[A]=V;
 }
 
+//Registers that move the next frame counter or DMC event have to see the
+//cycles owed to FCEU_SoundCPUHook first.
+static void SoundCPUSync(void)
+{
+	FCEU_SoundCPUFlush();
+	SoundCPUNext=0;
+}
+
 static DECLFW(Write_DMCRegs)
 {
+	SoundCPUSync();
 	A&=0xF;
 	
 	switch(A)
@@ -351,6 +365,7 @@ static DECLFW(StatusWrite)
 {
 	int x;
 
+	SoundCPUSync();
     DoSQ1();
     DoSQ2();
     DoTriangle();
@@ -394,10 +409,38 @@ static DECLFR(StatusRead)
    return ret;
 }
 
+static INLINE void ClockLengthCounters(void)
+{
+ int P;
+
+ for(P=0;P<2;P++)
+  if(!(PSG[P<<2]&0x20))  /* Make sure loop flag is not set. */
+   if(lengthcount[P]>0)
+    lengthcount[P]--;
+
+ if(!(PSG[8]&0x80))
+  if(lengthcount[2]>0)
+   lengthcount[2]--;
+
+ if(!(PSG[0xC]&0x20))  /* Make sure loop flag is not set. */
+  if(lengthcount[3]>0)
+   lengthcount[3]--;
+}
+
 static void FrameSoundStuff(int V)
 {
  int P;
 
+ /* Without sound only the length counters matter, since they show up
+    in $4015.  Envelopes, sweeps and the linear counter only shape the
+    output waveform. */
+ if(!FSettings.SndRate)
+ {
+  if(!(V&1))
+   ClockLengthCounters();
+  return;
+ }
+
  DoSQ1();
  DoSQ2();
  DoNoise();
@@ -405,20 +448,10 @@ static void FrameSoundStuff(int V)
 
  if(!(V&1)) /* Envelope decay, linear counter, length counter, freq sweep */
  {
-  if(!(PSG[8]&0x80))
-   if(lengthcount[2]>0)
-    lengthcount[2]--;
-
-  if(!(PSG[0xC]&0x20))  /* Make sure loop flag is not set. */
-   if(lengthcount[3]>0)
-    lengthcount[3]--;
+  ClockLengthCounters();
 
   for(P=0;P<2;P++)
   {
-   if(!(PSG[P<<2]&0x20))  /* Make sure loop flag is not set. */
-    if(lengthcount[P]>0)
-     lengthcount[P]--;
-
    /* Frequency Sweep Code Here */
    /* xxxx 0000 */
    /* xxxx = hz.  120/(x+1)*/
@@ -594,6 +627,26 @@ void FCEU_SoundCPUHook(int cycles)
   DMCShift>>=1;
   tester();
  }
+
+ //A pending DMA is taken at the next instruction.
+ if(DMCSize && !DMCHaveDMA)
+  SoundCPUNext=0;
+ else
+ {
+  SoundCPUNext=fhcnt>0 ? (fhcnt+47)/48 : 0;
+  if(DMCacc<SoundCPUNext)
+   SoundCPUNext=DMCacc;
+ }
+}
+
+void FCEU_SoundCPUFlush(void)
+{
+ if(SoundCPUCycles)
+ {
+  int32 cycles=SoundCPUCycles;
+  SoundCPUCycles=0;
+  FCEU_SoundCPUHook(cycles);
+ }
 }
 
 void RDoPCM(void)
@@ -1026,6 +1079,7 @@ static void RDoNoise(void)
 
 DECLFW(Write_IRQFM)
 {
+ SoundCPUSync();
  V=(V&0xC0)>>6;
  fcnt=0;
  if(V&0x2)
@@ -1055,11 +1109,12 @@ int FlushEmulateSound(void)
 
   if(!timestamp) return(0);
 
+  /* Nothing was synthesized, so there is nothing to filter or flush. */
   if(!FSettings.SndRate)
   {
-   left=0;
-   end=0;
-   goto nosoundo;
+   soundtsoffs=0;
+   inbuf=0;
+   return(0);
   }
 
   DoSQ1();
@@ -1103,7 +1158,6 @@ int FlushEmulateSound(void)
     Wave[0]=Wave[(end>>4)];
    Wave[end>>4]=0;
   }
-  nosoundo:
 
   if(FSettings.soundq>=1)
   {
@@ -1141,6 +1195,8 @@ void FCEUSND_Reset(void)
 	fhcnt=fhinc;
 	fcnt=0;
 	nreg=1;
+	SoundCPUCycles=0;
+	SoundCPUNext=0;
 
 	for(x=0;x<2;x++)
 	{
@@ -1282,6 +1338,7 @@ void SetSoundVariables(void)
   memset(ChannelBC,0,sizeof(ChannelBC));
 
   LoadDMCPeriod(DMCFormat&0xF);  // For changing from PAL to NTSC
+  SoundCPUNext=0;
 
   soundtsinc=(uint32)((uint64)(PAL?(long double)PAL_CPU*65536:(long double)NTSC_CPU*65536)/(FSettings.SndRate * 16));
 }
@@ -1394,6 +1451,8 @@ void FCEUSND_SaveState(void)
 
 void FCEUSND_LoadState(int version)
 {
+ SoundCPUCycles=0;
+ SoundCPUNext=0;
  LoadDMCPeriod(DMCFormat&0xF);
  RawDALatch&=0x7F;
  DMCAddress&=0x7FFF;
@@ -70,6 +70,9 @@ void FCEUSND_SaveState(void);
 void FCEUSND_LoadState(int version);
 
 void FCEU_SoundCPUHook(int);
+void FCEU_SoundCPUFlush(void);
+extern int32 SoundCPUCycles;
+extern int32 SoundCPUNext;
 void Write_IRQFM (uint32 A, uint8 V); //mbg merge 7/17/06 brought over from latest mmbuild
 
 void LogDPCM(int romaddress, int dpcmsize);
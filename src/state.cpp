@@ -363,7 +363,7 @@ int CurrentState=0;
 extern int geniestage;
 
 
-bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel)
+bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel, bool backbuffer)
 {
 	// reinit memory_savestate
 	// memory_savestate is global variable which already has its vector of bytes, so no need to allocate memory every time we use save/loadstate
@@ -400,7 +400,8 @@ bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel)
 			totalsize += 5 + size;
 		}
 	}
-	// save back buffer
+	// save back buffer, unless the caller keeps the screen itself
+	if(backbuffer)
 	{
 		extern uint8 *XBackBuf;
 		uint32 size = 256 * 256 + 8;
@@ -28,7 +28,7 @@ void FCEUSS_Save(const char *, bool display_message=true);
 bool FCEUSS_Load(const char *, bool display_message=true);
 
  //zlib values: 0 (none) through 9 (max) or -1 (default)
-bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel);
+bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel, bool backbuffer = true);
 
 bool FCEUSS_LoadFP(EMUFILE* is, ENUM_SSLOADPARAMS params);
 
@@ -42,40 +42,61 @@ void (*MapIRQHook)(int a);
  if (scanline < normalscanlines || scanline == totalscanlines) timestamp+=__x;  \
 }
 
-//normal memory read
+//normal memory read, straight from memory for RAM and PRG pages
 static INLINE uint8 RdMem(unsigned int A)
 {
- return(_DB=ARead[A](A));
+ uint8 *p=AReadPage[A>>8];
+ return(_DB=(p ? p[A] : ARead[A](A)));
 }
 
+//Hooks the CPU loop may have to call. X6502_Run is compiled once per set of
+//them, so the loop without any has no checks left for them.
+enum {
+ X6502_HOOK_DEBUG=1,	//DebugCycle (debugger builds)
+ X6502_HOOK_LUA=2,	//Lua memory hooks
+ X6502_HOOK_COUNT=4,	//instruction counters, read by the debugger and Lua
+ X6502_HOOK_IRQ=8	//MapIRQHook
+};
+
 //normal memory write
-static INLINE void WrMem(unsigned int A, uint8 V)
+template<int HOOKS>
+static INLINE void WrMemHooks(unsigned int A, uint8 V)
 {
 	BWrite[A](A,V);
 	#ifdef _S9XLUA_H
-	CallRegisteredLuaMemHook(A, 1, V, LUAMEMHOOK_WRITE);
+	if(HOOKS & X6502_HOOK_LUA)
+		CallRegisteredLuaMemHook(A, 1, V, LUAMEMHOOK_WRITE);
 	#endif
 }
 
 static INLINE uint8 RdRAM(unsigned int A)
 {
   //bbit edited: this was changed so cheat substituion would work
-  return(_DB=ARead[A](A));
+  //(pages with cheats have no AReadPage)
+  uint8 *p=AReadPage[A>>8];
+  return(_DB=(p ? p[A] : ARead[A](A)));
   // return(_DB=RAM[A]);
 }
 
-static INLINE void WrRAM(unsigned int A, uint8 V)
+template<int HOOKS>
+static INLINE void WrRAMHooks(unsigned int A, uint8 V)
 {
 	RAM[A]=V;
 	#ifdef _S9XLUA_H
-	CallRegisteredLuaMemHook(A, 1, V, LUAMEMHOOK_WRITE);
+	if(HOOKS & X6502_HOOK_LUA)
+		CallRegisteredLuaMemHook(A, 1, V, LUAMEMHOOK_WRITE);
 	#endif
 }
 
+//Only used inside X6502_RunHooks, whose hooks they follow.
+#define WrMem(A,V) WrMemHooks<HOOKS>(A,V)
+#define WrRAM(A,V) WrRAMHooks<HOOKS>(A,V)
+
 uint8 X6502_DMR(uint32 A)
 {
  ADDCYC(1);
- return(X.DB=ARead[A](A));
+ uint8 *p=AReadPage[A>>8];
+ return(X.DB=(p ? p[A] : ARead[A](A)));
 }
 
 void X6502_DMW(uint32 A, uint8 V)
@@ -116,6 +137,7 @@ static uint8 ZNTable[256];
   _PC+=disp;  \
   if((tmp^_PC)&0x100)  \
   ADDCYC(1);  \
+  IDLELOOP(disp<0 && disp>=-IDLE_LOOP_BYTES);  \
  }  \
  else _PC++;  \
 }
@@ -353,6 +375,161 @@ static uint8 CycTable[256] =
 /*0xF0*/ 2,5,2,8,4,4,6,6,2,4,2,7,4,4,7,7,
 };
 
+/* Idle loops.  Games often spin on a RAM flag, or jump to themselves, until
+   the NMI handler ends the wait.  On a short backward branch or jump, one
+   pass of the loop is evaluated on copies of the registers; if it only reads
+   plain memory and leaves them as they were, the passes left before the
+   next event are skipped at once. */
+#define IDLE_LOOP_BYTES 16
+#define IDLE_LOOP_OPS   8
+
+#define IDLE_ZN(r)     p=(p&~(Z_FLAG|N_FLAG))|ZNTable[r]
+#define IDLE_CMP(r)    p=(p&~(Z_FLAG|N_FLAG|C_FLAG))|ZNTable[(uint8)(r-v)]|(r>=v?C_FLAG:0)
+
+static INLINE int IdleRead(uint32 A, uint8 *v)
+{
+ uint8 *p=AReadPage[(A&0xFFFF)>>8];
+ if(!p) return 0;
+ *v=p[A&0xFFFF];
+ return 1;
+}
+
+//Returns the cycles of one pass of the loop at _PC, 0 if it is not idle in
+//this state and -1 if its first instruction rules it out for good.  *db is
+//the last byte the pass reads.
+static int32 X6502_IdleLoopCycles(uint8 *db)
+{
+ uint32 pc=_PC;
+ int32 cycles=0;
+ uint8 a=_A,x=_X,y=_Y,p=_P;
+ int ops;
+
+ for(ops=0;ops<IDLE_LOOP_OPS;ops++)
+ {
+  uint8 op,lo,hi,v;
+
+  if(((pc-_PC)&0xFFFF)>=IDLE_LOOP_BYTES) return 0;
+  if(!IdleRead(pc,&op)) goto reject;
+  cycles+=CycTable[op];
+  if(op==0xEA)
+  {
+   pc=(pc+1)&0xFFFF;
+   continue;
+  }
+  if(!IdleRead(pc+1,&lo)) goto reject;
+  *db=lo;
+  switch(op)
+  {
+   //Branches: bits 7-6 select N, V, C or Z, bit 5 the value to branch on.
+   case 0x10: case 0x30: case 0x50: case 0x70:
+   case 0x90: case 0xB0: case 0xD0: case 0xF0:
+   {
+    static const uint8 flags[4]={N_FLAG,V_FLAG,C_FLAG,Z_FLAG};
+    uint32 next=(pc+2)&0xFFFF;
+    uint32 target;
+
+    pc=next;
+    if(((p&flags[op>>6])!=0)!=((op>>5)&1)) continue;
+    target=(next+(int8)lo)&0xFFFF;
+    cycles++;
+    if((next^target)&0x100) cycles++;
+    if(target!=_PC) return 0;
+    goto pass_done;
+   }
+   case 0x4C:
+    if(!IdleRead(pc+2,&hi)) goto reject;
+    *db=hi;
+    if((lo|(hi<<8))!=_PC) return 0;
+    goto pass_done;
+
+   case 0xA9: case 0xA2: case 0xA0: case 0xC9: case 0xE0: case 0xC0: case 0x29: case 0x09:
+    v=lo;
+    pc+=2;
+    break;
+   case 0xA5: case 0xA6: case 0xA4: case 0xC5: case 0xE4: case 0xC4: case 0x25: case 0x05: case 0x24:
+    if(!IdleRead(lo,&v)) goto reject;
+    pc+=2;
+    break;
+   case 0xAD: case 0xAE: case 0xAC: case 0xCD: case 0xEC: case 0xCC: case 0x2D: case 0x0D: case 0x2C:
+    if(!IdleRead(pc+2,&hi) || !IdleRead(lo|(hi<<8),&v)) goto reject;
+    pc+=3;
+    break;
+   default:
+    goto reject;
+  }
+  *db=v;
+  pc&=0xFFFF;
+  switch(op)
+  {
+   case 0xA9: case 0xA5: case 0xAD: a=v; IDLE_ZN(a); break;
+   case 0xA2: case 0xA6: case 0xAE: x=v; IDLE_ZN(x); break;
+   case 0xA0: case 0xA4: case 0xAC: y=v; IDLE_ZN(y); break;
+   case 0xC9: case 0xC5: case 0xCD: IDLE_CMP(a); break;
+   case 0xE0: case 0xE4: case 0xEC: IDLE_CMP(x); break;
+   case 0xC0: case 0xC4: case 0xCC: IDLE_CMP(y); break;
+   case 0x29: case 0x25: case 0x2D: a&=v; IDLE_ZN(a); break;
+   case 0x09: case 0x05: case 0x0D: a|=v; IDLE_ZN(a); break;
+   default: //BIT
+    p=(p&~(Z_FLAG|V_FLAG|N_FLAG))|(ZNTable[v&a]&Z_FLAG)|(v&(V_FLAG|N_FLAG));
+    break;
+  }
+ }
+ return 0;
+
+reject:
+ return ops ? 0 : -1;
+
+pass_done:
+ if(a!=_A || x!=_X || y!=_Y || p!=_P) return 0;
+ return cycles;
+}
+
+#undef IDLE_ZN
+#undef IDLE_CMP
+
+//Loop heads whose first instruction can never idle, plus one, by low bits.
+static uint32 IdleLoopRejects[16];
+
+//Called after a backward branch or jump to _PC.  Skips whole passes of an
+//idle loop, stopping short of the end of this slice, where the PPU may raise
+//NMI, and of the next APU event, which may raise IRQ.
+static void X6502_SkipIdleLoop(void)
+{
+ uint8 db=_DB;
+ int32 cycles;
+ int32 passes;
+ int timed;
+
+ cycles=X6502_IdleLoopCycles(&db);
+ if(cycles<0) IdleLoopRejects[_PC&15]=_PC+1;
+ if(cycles<=0) return;
+ passes=(_count-1)/(cycles*48);
+ timed=scanline < normalscanlines || scanline == totalscanlines;
+ if(timed)
+ {
+  int32 room=SoundCPUNext-SoundCPUCycles-1;
+  if(room<cycles*passes)
+   passes=room<0 ? 0 : room/cycles;
+ }
+ if(passes<=0) return;
+
+ _count-=passes*cycles*48;
+ if(timed)
+ {
+  timestamp+=passes*cycles;
+  SoundCPUCycles+=passes*cycles;
+ }
+ _DB=db;
+}
+
+//Only the loop without hooks may skip ahead; the others have to see every pass.
+//An IRQ that is already pending must stay masked by the loop.  Known busy
+//loops are turned away here, as they branch back far too often for a call.
+#define IDLELOOP(back)  \
+ if(!HOOKS && (back) && IdleLoopRejects[_PC&15]!=_PC+1u &&  \
+    (!_IRQlow || ((_P&I_FLAG) && !(_IRQlow&(FCEU_IQRESET|FCEU_IQNMI2|FCEU_IQNMI|FCEU_IQTEMP)))))  \
+  X6502_SkipIdleLoop()
+
 void X6502_IRQBegin(int w)
 {
  _IRQlow|=w;
@@ -409,10 +586,12 @@ void X6502_Power(void)
  _count=_tcount=_IRQlow=_PC=_A=_X=_Y=_P=_PI=_DB=_jammed=0;
  _S=0xFD;
  timestamp=0;
+ memset(IdleLoopRejects,0,sizeof(IdleLoopRejects));
  X6502_Reset();
 }
 
-void X6502_Run(int32 cycles)
+template<int HOOKS>
+static void X6502_RunHooks(int32 cycles)
 {
   if(PAL)
    cycles*=15;    // 15*4=60
@@ -420,7 +599,6 @@ void X6502_Run(int32 cycles)
    cycles*=16;    // 16*4=64
 
   _count+=cycles;
-extern int test; test++;
   while(_count>0)
   {
    int32 temp;
@@ -481,9 +659,13 @@ extern int test; test++;
    }
 
 	//will probably cause a major speed decrease on low-end systems
-   DEBUG( DebugCycle() );
+   if(HOOKS & X6502_HOOK_DEBUG)
+   {
+    DEBUG( DebugCycle() );
+   }
 
-   IncrementInstructionsCounters();
+   if(HOOKS & X6502_HOOK_COUNT)
+    IncrementInstructionsCounters();
 
    _PI=_P;
    b1=RdMem(_PC);
@@ -492,12 +674,17 @@ extern int test; test++;
 
    temp=_tcount;
    _tcount=0;
-   if(MapIRQHook) MapIRQHook(temp);
+   if(HOOKS & X6502_HOOK_IRQ) MapIRQHook(temp);
    
    if (scanline < normalscanlines || scanline == totalscanlines)
-    FCEU_SoundCPUHook(temp);
+   {
+    SoundCPUCycles+=temp;
+    if(SoundCPUCycles>=SoundCPUNext)
+     FCEU_SoundCPUFlush();
+   }
    #ifdef _S9XLUA_H
-   CallRegisteredLuaMemHook(_PC, 1, 0, LUAMEMHOOK_EXEC);
+   if(HOOKS & X6502_HOOK_LUA)
+    CallRegisteredLuaMemHook(_PC, 1, 0, LUAMEMHOOK_EXEC);
    #endif
    _PC++;
    switch(b1)
@@ -507,6 +694,36 @@ extern int test; test++;
   }
 }
 
+#undef WrMem
+#undef WrRAM
+
+#ifdef FCEUDEF_DEBUGGER
+#define X6502_BUILD_HOOKS (X6502_HOOK_DEBUG|X6502_HOOK_COUNT)
+#else
+#define X6502_BUILD_HOOKS 0
+#endif
+
+//Indexed by Lua running * 2 + MapIRQHook set.
+static void (*const X6502_RunVariants[4])(int32 cycles) = {
+ X6502_RunHooks<X6502_BUILD_HOOKS>,
+ X6502_RunHooks<X6502_BUILD_HOOKS|X6502_HOOK_IRQ>,
+ X6502_RunHooks<X6502_BUILD_HOOKS|X6502_HOOK_LUA|X6502_HOOK_COUNT>,
+ X6502_RunHooks<X6502_BUILD_HOOKS|X6502_HOOK_LUA|X6502_HOOK_COUNT|X6502_HOOK_IRQ>
+};
+
+void X6502_Run(int32 cycles)
+{
+  int variant=MapIRQHook ? 1 : 0;
+  #ifdef _S9XLUA_H
+  if(FCEU_LuaRunning())
+   variant|=2;
+  #endif
+  X6502_RunVariants[variant](cycles);
+
+  //Leave the APU counters as exact as after every instruction.
+  FCEU_SoundCPUFlush();
+}
+
 //--------------------------
 //---Called from debuggers
 void FCEUI_NMI(void)
@@ -0,0 +1,48 @@
+# Tests for NESInterface snapshots. They need a ROM: set NES_TEST_ROM to its path.
+import os
+import unittest
+
+import numpy as np
+
+import nes_python_interface
+
+ROM = os.environ.get('NES_TEST_ROM')
+
+
+@unittest.skipUnless(ROM, 'NES_TEST_ROM is not set')
+class NESInterfaceStateTest(unittest.TestCase):
+
+    def play(self, nes, actions):
+        trace = []
+        for action in actions:
+            reward = nes.act(action)
+            trace.append((reward, nes.getRAM().copy(), nes.getScreen().copy()))
+        return trace
+
+    def assertSameTrace(self, first, second):
+        self.assertEqual(len(first), len(second))
+        for (reward1, ram1, screen1), (reward2, ram2, screen2) in zip(first, second):
+            self.assertEqual(reward1, reward2)
+            np.testing.assert_array_equal(ram1, ram2)
+            np.testing.assert_array_equal(screen1, screen2)
+
+    def test_restore_replays_sticky_actions(self):
+        nes = nes_python_interface.NESInterface(ROM)
+        nes.setSeed(7)
+        nes.setRepeatActionProbability(0.5)
+        nes.reset_game()
+        actions = nes.getLegalActionSet()
+        rng = np.random.RandomState(3)
+        for action in rng.choice(actions, 20):
+            nes.act(action)
+
+        state = nes.cloneSystemState()
+        steps = rng.choice(actions, 100)
+        first = self.play(nes, steps)
+        self.assertTrue(nes.restoreSystemState(state))
+        second = self.play(nes, steps)
+        self.assertSameTrace(first, second)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,44 @@
+# Tests for NESVectorEnv. They need a ROM: set NES_TEST_ROM to its path.
+import os
+import unittest
+
+import numpy as np
+
+import nes_python_interface
+from nes_python_interface import nes_python_interface as nes_module
+
+ROM = os.environ.get('NES_TEST_ROM')
+
+
+@unittest.skipUnless(ROM, 'NES_TEST_ROM is not set')
+class NESVectorEnvTest(unittest.TestCase):
+
+    def setUp(self):
+        self.native = nes_module._nes_native
+
+    def tearDown(self):
+        nes_module._nes_native = self.native
+
+    def test_act_without_native_extension(self):
+        nes_module._nes_native = None
+        env = nes_python_interface.NESVectorEnv(ROM, 2)
+        single = nes_python_interface.NESInterface(ROM)
+        env.reset_all()
+        single.reset_game()
+
+        for step in range(30):
+            result = env.act([0, 0])
+            self.assertIsNotNone(result)
+            rewards, dones, screens = result
+            self.assertEqual(rewards.shape, (2,))
+            self.assertEqual(dones.shape, (2,))
+            self.assertEqual(screens.shape, (2, env.screen_size))
+            single.act(0)
+
+        expected = single.getScreen().ravel()
+        np.testing.assert_array_equal(screens[0], expected)
+        np.testing.assert_array_equal(screens[1], expected)
+
+
+if __name__ == '__main__':
+    unittest.main()